@@ -28,6 +28,12 @@ var videosInPage = [];
 var durations = [];
 /* +- for video seek and counters display*/
 var deviation = 100;
+/* detector event stream, e.g. index.html?live=http://127.0.0.1:8090/events */
+var liveUrl = new URLSearchParams(window.location.search).get('live');
+var liveData = null;
+var liveEvents = null;
+/* canplay fires again after every seek; only the first one subscribes */
+var liveSource = null;
 
 var timelineData = {
     start_time: 0,
@@ -48,12 +54,63 @@ $(document).ready(function () {
     $("#video1").on(
         "canplay",
         function(event) {
-            generateTimelines();
-            generateAlerts();
+            if (liveUrl) {
+                if (liveSource === null) {
+                    liveSource = subscribeLive(liveUrl);
+                }
+            } else {
+                generateTimelines();
+                generateAlerts();
+            }
         });
 });
 
+/* Keep the timeline and alerts current from the detector's event stream.
+   The snapshot has the same shape as data.json/events.json. */
+function subscribeLive(url) {
+    var source = new EventSource(url);
+
+    source.addEventListener('snapshot', function(e) {
+        var snap = JSON.parse(e.data);
+        liveData = snap.data;
+        liveEvents = snap.events;
+        renderTimelines(liveData);
+        renderAlerts(liveEvents);
+    });
+
+    source.addEventListener('detection', function(e) {
+        var evt = JSON.parse(e.data);
+        if (liveData[evt.video] === undefined) {
+            liveData[evt.video] = {};
+            liveEvents[evt.video] = {};
+        }
+        liveData[evt.video][evt.videoTime] = evt.count;
+        liveData.totals[evt.video] = evt.count;
+        liveEvents[evt.video][Object.keys(liveEvents[evt.video]).length] = {
+            time: evt.time,
+            content: evt.content,
+            videoTime: evt.videoTime
+        };
+        renderTimelines(liveData);
+        renderAlerts(liveEvents);
+    });
+
+    source.onerror = function() {
+        console.log("Live event stream disconnected, retrying");
+    };
+
+    return source;
+}
+
 function generateTimelines() {
+    $.getJSON('resources/video_data/data.json')
+        .done(renderTimelines)
+        .fail(function(data){
+            console.log("Data for video could not be loaded!");
+        });
+}
+
+function renderTimelines(json) {
 
     //reset timelinedata before reading it again
     timelineData = {
@@ -85,46 +142,47 @@ function generateTimelines() {
 
     timelineData.stop_time = Math.max.apply(Math,durations)*1000;
 
-    $.getJSON('resources/video_data/data.json')
-        .done(function(data) {
-            var json = data;
+    for (var i in json) {
+        if (timelineData.lines[i] !== undefined && jQuery.inArray(i, Object.keys(videosInPage)) !== -1) {
 
-            for (var i in json) {
-                if (timelineData.lines[i] !== undefined && jQuery.inArray(i, Object.keys(videosInPage)) !== -1) {
+            for (var idx in json[i]) {
+                timelineData.lines[i].events.push({
+                    id: (timelineData.lines[i].events.length+1),
+                    time: idx*1000,
+                    counter: json[i][idx]
+                });
+            }
 
-                    for (var idx in json[i]) {
-                        timelineData.lines[i].events.push({
-                            id: (timelineData.lines[i].events.length+1),
-                            time: idx*1000,
-                            counter: json[i][idx]
-                        });
-                    }
+            timelineData.lines[i].total = json['totals'][i];
+        }
+    }
 
-                    timelineData.lines[i].total = json['totals'][i];
-                }
-            }
+    $('.tl').html('');
+    $('.tl').timeline(timelineData);
 
-            $('.tl').html('');
-            $('.tl').timeline(timelineData);
 
+    //size of panels with timeline and alerts must be identical
+    var heightLeft = $(".panel-left").map(function() {
+        return $(this).height();
+    }).get();
+    $(".panel-right").height(heightLeft);
 
-            //size of panels with timeline and alerts must be identical
-            var heightLeft = $(".panel-left").map(function() {
-                return $(this).height();
-            }).get();
-            $(".panel-right").height(heightLeft);
+    //alerts are size to match panel heights
 
-            //alerts are size to match panel heights
+    $('.scrollbar-light').slimScroll({
+        height: heightLeft
+    });
+}
 
-            $('.scrollbar-light').slimScroll({
-                height: heightLeft
-            });
-        })
+function generateAlerts() {
+    $.getJSON('resources/video_data/events.json')
+        .done(renderAlerts)
         .fail(function(data){
-            console.log("Data for video could not be loaded!");
+            console.log("Events for video could not be loaded!");
         });
 }
-function generateAlerts() {
+
+function renderAlerts(json) {
 
     //reset timelinedata before reading it again
     alertsData = {
@@ -132,31 +190,23 @@ function generateAlerts() {
         lines: []
     };
 
-    $.getJSON('resources/video_data/events.json')
-        .done(function(data) {
-            var json = data;
-
-            for (var i in json) {
-                alertsData.videoId = i;
-                if (jQuery.inArray(i, Object.keys(videosInPage)) !== -1) {
-                    for (var idx in json[i]) {
-                        alertsData.lines.push({
-                            time: json[i][idx]['time'],
-                            videoTime: parseFloat(json[i][idx]['videoTime'],3)*1000,
-                            content: json[i][idx]['content']
-                        });
-                    }
-                }
+    for (var i in json) {
+        alertsData.videoId = i;
+        if (jQuery.inArray(i, Object.keys(videosInPage)) !== -1) {
+            for (var idx in json[i]) {
+                alertsData.lines.push({
+                    time: json[i][idx]['time'],
+                    videoTime: parseFloat(json[i][idx]['videoTime'],3)*1000,
+                    content: json[i][idx]['content']
+                });
             }
+        }
+    }
 
-            $('#detection-alert').html('');
-            $('#detection-alert').detectionAlert(alertsData);
+    $('#detection-alert').html('');
+    $('#detection-alert').detectionAlert(alertsData);
 
-            $("i.fa-play").click(onClickTimelineBullet);
-        })
-        .fail(function(data){
-            console.log("Events for video could not be loaded!");
-        });
+    $("i.fa-play").click(onClickTimelineBullet);
 }
 
 function onClickTimelineBullet() {
@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <nlohmann/json.hpp>
+
+// Time given to an editor to finish writing before the file is read
+static const int config_settleMs = 200;
+
+// One stream of config.json, with the settings of its input group. The
+// pipeline names streams after their stream id, which is never reused.
+struct StreamSpec {
+	std::string video;
+	size_t netHeight = 0;
+	size_t netWidth = 0;
+	std::string netPrecision = "U8";
+	bool tiled = false;
+	float overlap = 0.2f;
+	bool skipStatic = false;
+
+	// Streams with equal keys are the same stream across reloads
+	std::string key() const
+	{
+		char settings[96];
+		snprintf(settings, sizeof(settings), "|%zux%zu %s|%d %.3f %d", netHeight, netWidth,
+			 netPrecision.c_str(), tiled, overlap, skipStatic);
+		return video + settings;
+	}
+};
+
+typedef struct {
+	std::vector<StreamSpec> streams;
+	std::vector<std::string> labels;
+	double threshold;
+	int candidateConfidence;
+} AppConfig;
+
+// Read config.json into cfg. Returns false with a message in error if the
+// file is not a valid configuration.
+inline bool parseConfig(std::istream &in, AppConfig *cfg, std::string *error)
+{
+	nlohmann::json obj;
+	try
+	{
+		in >> obj;
+		cfg->streams.clear();
+		cfg->labels.clear();
+		cfg->threshold = obj.value("threshold", 0.55);
+		cfg->candidateConfidence = obj.value("candidate_confidence", 4);
+
+		auto inputs = obj.at("inputs");
+		for (size_t i = 0; i < inputs.size(); ++i)
+		{
+			auto group = inputs[i];
+			auto videos = group.at("video");
+			for (size_t j = 0; j < videos.size(); ++j)
+			{
+				StreamSpec spec;
+				spec.video = videos[j].get<std::string>();
+				// Optional network input shape [height, width] and precision for this group
+				if (group.count("shape"))
+				{
+					spec.netHeight = group["shape"][0];
+					spec.netWidth = group["shape"][1];
+				}
+				spec.netPrecision = group.value("precision", std::string("U8"));
+				if (group.count("tiling"))
+				{
+					spec.tiled = true;
+					spec.overlap = group["tiling"].value("overlap", 0.2f);
+					spec.skipStatic = group["tiling"].value("skip_static", false);
+				}
+				cfg->streams.push_back(spec);
+			}
+			for (auto &label : group.at("label"))
+				cfg->labels.push_back(label);
+		}
+	}
+	catch (const std::exception &e)
+	{
+		*error = e.what();
+		return false;
+	}
+	if (cfg->candidateConfidence < 1)
+	{
+		*error = "candidate_confidence must be at least 1";
+		return false;
+	}
+	return true;
+}
+
+// Watches config.json with inotify and parses it again whenever it is saved.
+// The directory is watched rather than the file, so that editors which save
+// by writing a new file and renaming it over the old one are seen too. The
+// parsed configuration is only handed over; applying it is up to the caller.
+class ConfigWatcher {
+public:
+	~ConfigWatcher()
+	{
+		stop();
+	}
+
+	bool start(const std::string &path)
+	{
+		size_t slash = path.rfind('/');
+		std::string dir = slash == std::string::npos ? "." : path.substr(0, slash);
+		fileName = slash == std::string::npos ? path : path.substr(slash + 1);
+		filePath = path;
+
+		inotifyFd = inotify_init1(IN_NONBLOCK);
+		if (inotifyFd < 0)
+			return false;
+		if (inotify_add_watch(inotifyFd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+		{
+			close(inotifyFd);
+			inotifyFd = -1;
+			return false;
+		}
+		wakeFd = eventfd(0, EFD_NONBLOCK);
+		running = true;
+		worker = std::thread(&ConfigWatcher::loop, this);
+		return true;
+	}
+
+	void stop()
+	{
+		if (!running)
+			return;
+		running = false;
+		uint64_t one = 1;
+		ssize_t n = write(wakeFd, &one, sizeof(one));
+		(void)n;
+		if (worker.joinable())
+			worker.join();
+		close(inotifyFd);
+		close(wakeFd);
+	}
+
+	// Take the configuration parsed since the last call, if any
+	bool poll(AppConfig *cfg)
+	{
+		if (!changed.load(std::memory_order_acquire))
+			return false;
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		*cfg = pending;
+		changed.store(false, std::memory_order_relaxed);
+		return true;
+	}
+
+private:
+	std::string filePath;
+	std::string fileName;
+	int inotifyFd = -1;
+	int wakeFd = -1;
+	std::atomic<bool> running{false};
+	std::atomic<bool> changed{false};
+	std::thread worker;
+	std::mutex pendingMutex;
+	AppConfig pending;
+
+	// Drain the inotify queue and tell whether config.json was among the events
+	bool configTouched()
+	{
+		bool touched = false;
+		char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+		ssize_t len;
+		while ((len = read(inotifyFd, buf, sizeof(buf))) > 0)
+		{
+			for (char *p = buf; p < buf + len; p += sizeof(inotify_event) + ((inotify_event *)p)->len)
+			{
+				inotify_event *ev = (inotify_event *)p;
+				if (ev->len && fileName == ev->name)
+					touched = true;
+			}
+		}
+		return touched;
+	}
+
+	void loop()
+	{
+		pollfd fds[2] = {{inotifyFd, POLLIN, 0}, {wakeFd, POLLIN, 0}};
+		while (running)
+		{
+			if (::poll(fds, 2, -1) <= 0 || !running)
+				continue;
+			if (!configTouched())
+				continue;
+
+			// Let a burst of writes from the editor settle before reading
+			while (::poll(fds, 1, config_settleMs) > 0 && running)
+				configTouched();
+
+			std::ifstream file(filePath);
+			AppConfig cfg;
+			std::string error;
+			if (!file.is_open() || !parseConfig(file, &cfg, &error))
+			{
+				std::cout << "Ignoring changed config file " << filePath << ": "
+					<< (error.empty() ? "could not open it" : error) << std::endl;
+				continue;
+			}
+			std::lock_guard<std::mutex> lock(pendingMutex);
+			pending = cfg;
+			changed.store(true, std::memory_order_release);
+		}
+	}
+};
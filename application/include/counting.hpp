@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <detector.hpp>
+#include <metrics.hpp>
+#include <videocap.hpp>
+
+// Whether a detection is more confident than threshold and of one of the
+// requested labels
+inline bool isCounted(const Detection &det, const std::vector<bool> &usedLabels, double threshold)
+{
+	return det.confidence > threshold && det.label >= 0 &&
+		det.label < (int)usedLabels.size() && usedLabels[det.label];
+}
+
+// Count the detections of one processed frame and debounce the per-label
+// counts: a new count is only accepted once it has been seen
+// candidateConfidence frames in a row. A streak already longer than a
+// lowered candidateConfidence is accepted on its next frame. onIncrease(label,
+// added) is called for every label whose accepted count went up, after its
+// totalCount has been updated.
+inline void countDetections(VideoCap *vcap, const std::vector<Detection> &detections,
+			    const std::vector<bool> &usedLabels, const std::vector<int> &labelPos,
+			    double threshold, int candidateConfidence,
+			    const std::function<void(int, int)> &onIncrease)
+{
+	for (int i = 0; i < vcap->noLabels; ++i)
+	{
+		vcap->currentCount[i] = 0;
+		vcap->changedCount[i] = false;
+	}
+
+	for (const Detection &det : detections)
+	{
+		if (isCounted(det, usedLabels, threshold))
+			vcap->currentCount[labelPos[det.label]]++;
+	}
+
+	for (int i = 0; i < vcap->noLabels; ++i)
+	{
+		if (vcap->candidateCount[i] == vcap->currentCount[i])
+			vcap->candidateConfidence[i]++;
+		else
+		{
+			vcap->candidateConfidence[i] = 0;
+			vcap->candidateCount[i] = vcap->currentCount[i];
+		}
+
+		if (vcap->candidateConfidence[i] >= candidateConfidence)
+		{
+			vcap->candidateConfidence[i] = 0;
+			vcap->changedCount[i] = true;
+		}
+		else
+			continue;
+
+		if (vcap->currentCount[i] > vcap->lastCorrectCount[i])
+		{
+			int detObj = vcap->currentCount[i] - vcap->lastCorrectCount[i];
+			vcap->totalCount[i] += detObj;
+			onIncrease(i, detObj);
+		}
+
+		vcap->lastCorrectCount[i] = vcap->currentCount[i];
+	}
+	++vcap->frameCount;
+}
+
+// Add the event for one new object to vcap->events, dropping the oldest one
+// past conf_recentEvents, and return its log line
+inline std::string recordEvent(VideoCap *vcap, const std::string &labelName, const tm &when)
+{
+	int totalCount = 0;
+	for (auto cnt : vcap->totalCount)
+		totalCount += cnt;
+
+	char str[256];
+	snprintf(str, sizeof(str), "%02d:%02d:%02d - Intruder %s detected on %s", when.tm_hour,
+		 when.tm_min, when.tm_sec, labelName.c_str(), vcap->camName.c_str());
+
+	event evt;
+	snprintf(evt.time, sizeof(evt.time), "%02d:%02d:%02d", when.tm_hour, when.tm_min, when.tm_sec);
+	evt.intruder = labelName;
+	evt.frame = vcap->frameCount;
+	evt.count = totalCount;
+	vcap->events.push_back(evt);
+	if (vcap->events.size() > conf_recentEvents)
+		vcap->events.pop_front();
+	metrics().eventDetected(labelName);
+
+	return str;
+}
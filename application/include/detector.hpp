@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+
+// One box decoded from an SSD output row. Coordinates are relative to the
+// image (0..1); label is the zero-based position in the labels file and
+// imageId the position of the image in a batched request.
+typedef struct {
+	int imageId;
+	int label;
+	float confidence;
+	float xmin;
+	float ymin;
+	float xmax;
+	float ymax;
+} Detection;
+
+// Floats per SSD output row: image_id, label, confidence, xmin, ymin, xmax, ymax
+static const int ssd_objectSize = 7;
+
+typedef struct {
+	std::vector<float> ssd; // Raw SSD output rows
+	std::vector<Detection> detections; // Rows decoded by parseSSD()
+} DetectorResult;
+
+enum DetectStatus {
+	DETECT_OK,
+	DETECT_NOT_STARTED, // Nothing has been submitted to the slot being waited on
+	DETECT_FAILED
+};
+
+// Decode SSD output rows, stopping at the first row with a negative image_id
+inline void parseSSD(const float *rows, int count, std::vector<Detection> *detections)
+{
+	detections->clear();
+	for (int c = 0; c < count; ++c)
+	{
+		const float *localbox = &rows[c * ssd_objectSize];
+		if (localbox[0] < 0)
+			break;
+		Detection d;
+		d.imageId = (int)localbox[0];
+		d.label = (int)(localbox[1] - 1);
+		d.confidence = localbox[2];
+		d.xmin = localbox[3];
+		d.ymin = localbox[4];
+		d.xmax = localbox[5];
+		d.ymax = localbox[6];
+		detections->push_back(d);
+	}
+}
+
+// Object detection backend. Submitted frames complete in order: wait()
+// returns the result of the oldest frame not yet waited for. Backends keep
+// at least two frames in flight, so the next frame can be submitted while
+// the previous one is still running.
+class Detector {
+public:
+	std::string name; // Input shape and precision, used when reporting
+	int shapeId = 0;
+	uint64_t framesInferred = 0;
+	uint64_t detectionsCounted = 0;
+
+	virtual ~Detector() {}
+
+	// Input resolution expected by submit()
+	virtual size_t inputWidth() const = 0;
+	virtual size_t inputHeight() const = 0;
+	virtual size_t inputChannels() const = 0;
+
+	// Start detection on a frame already resized to the input resolution
+	virtual void submit(const cv::Mat &frame) = 0;
+
+	// Start detection on up to batchSize() images in one request; detections
+	// on images[i] are reported with imageId i
+	virtual void submitBatch(const std::vector<cv::Mat> &images)
+	{
+		submit(images.at(0));
+	}
+
+	virtual size_t batchSize() const
+	{
+		return 1;
+	}
+
+	// Block until the oldest outstanding frame is done. Returns
+	// DETECT_NOT_STARTED if nothing is outstanding.
+	virtual DetectStatus wait(DetectorResult *result) = 0;
+};
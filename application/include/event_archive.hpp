@@ -0,0 +1,352 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Event archive: segment files of fixed-size event records, each with a
+// sparse index. A segment is laid out as
+//
+//   ArchiveHeader
+//   ArchiveIndexEntry index[archive_segmentRecords / archive_indexStride]
+//   ArchiveRecord records[archive_segmentRecords]
+//
+// and is created at its full size and memory-mapped, so appending an event
+// is a copy into the mapping. Each index entry covers archive_indexStride
+// consecutive records with their time range and bitmasks of the streams and
+// labels they contain, so a query only visits the blocks that can match.
+// The record count in the header is published last, so the archive can be
+// queried while the detector is still writing to it.
+
+static const char archive_magic[8] = {'I', 'D', 'E', 'V', 'E', 'N', 'T', 'S'};
+static const uint32_t archive_version = 1;
+static const uint32_t archive_segmentRecords = 1 << 16;
+static const uint32_t archive_indexStride = 256;
+static const size_t archive_nameSize = 24;
+
+struct ArchiveHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t recordSize;
+	uint32_t capacity;
+	uint32_t indexStride;
+	uint32_t count; // Records written, published with release order
+	uint32_t reserved;
+	int64_t minUs;
+	int64_t maxUs;
+	char padding[16];
+};
+
+struct ArchiveIndexEntry {
+	int64_t minUs;
+	int64_t maxUs;
+	uint64_t streamMask;
+	uint64_t labelMask;
+};
+
+// One detected object
+struct ArchiveRecord {
+	int64_t timeUs; // Wall clock, microseconds since the epoch
+	int32_t frame; // Frame of the stream the object was counted on
+	int32_t count; // Objects counted on the stream so far
+	int32_t stream; // Stream ID of the run that wrote the record
+	int32_t reserved;
+	char streamName[archive_nameSize];
+	char label[archive_nameSize];
+};
+
+// Bit of a stream or label name in the index masks
+inline uint64_t archiveNameBit(const char *name)
+{
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < archive_nameSize && name[i]; ++i)
+		h = (h ^ (unsigned char)name[i]) * 16777619u;
+	return 1ull << (h % 64);
+}
+
+inline size_t archiveSegmentSize()
+{
+	return sizeof(ArchiveHeader) + sizeof(ArchiveIndexEntry) * (archive_segmentRecords / archive_indexStride) +
+		sizeof(ArchiveRecord) * archive_segmentRecords;
+}
+
+// Segment file names sorted by sequence number, oldest first
+inline std::vector<std::string> archiveSegments(const std::string &dir)
+{
+	std::vector<std::string> names;
+	DIR *d = opendir(dir.c_str());
+	if (!d)
+		return names;
+	while (dirent *e = readdir(d))
+	{
+		std::string name = e->d_name;
+		if (name.size() > 4 && name.compare(name.size() - 4, 4, ".seg") == 0)
+			names.push_back(name);
+	}
+	closedir(d);
+	std::sort(names.begin(), names.end());
+	return names;
+}
+
+// A mapped segment file
+class ArchiveSegment {
+public:
+	ArchiveSegment() {}
+	ArchiveSegment(const ArchiveSegment &) = delete;
+	ArchiveSegment &operator=(const ArchiveSegment &) = delete;
+
+	~ArchiveSegment()
+	{
+		close();
+	}
+
+	// Map an existing segment, or create it when create is set
+	bool open(const std::string &path, bool writable, bool create)
+	{
+		close();
+		int fd = ::open(path.c_str(), writable ? (O_RDWR | (create ? O_CREAT | O_EXCL : 0)) : O_RDONLY, 0644);
+		if (fd < 0)
+			return false;
+		size = archiveSegmentSize();
+		struct stat st;
+		if ((create && ftruncate(fd, size) < 0) || fstat(fd, &st) < 0 || (size_t)st.st_size != size)
+		{
+			::close(fd);
+			return false;
+		}
+		void *p = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED)
+			return false;
+		data = (char *)p;
+
+		if (create)
+		{
+			ArchiveHeader h;
+			memset(&h, 0, sizeof(h));
+			memcpy(h.magic, archive_magic, sizeof(h.magic));
+			h.version = archive_version;
+			h.recordSize = sizeof(ArchiveRecord);
+			h.capacity = archive_segmentRecords;
+			h.indexStride = archive_indexStride;
+			memcpy(data, &h, sizeof(h));
+		}
+		const ArchiveHeader *h = header();
+		if (memcmp(h->magic, archive_magic, sizeof(h->magic)) != 0 || h->version != archive_version ||
+		    h->recordSize != sizeof(ArchiveRecord) || h->capacity != archive_segmentRecords ||
+		    h->indexStride != archive_indexStride)
+		{
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close()
+	{
+		if (data)
+			munmap(data, size);
+		data = nullptr;
+	}
+
+	ArchiveHeader *header() const
+	{
+		return (ArchiveHeader *)data;
+	}
+
+	ArchiveIndexEntry *index() const
+	{
+		return (ArchiveIndexEntry *)(data + sizeof(ArchiveHeader));
+	}
+
+	ArchiveRecord *records() const
+	{
+		return (ArchiveRecord *)(data + sizeof(ArchiveHeader) +
+			sizeof(ArchiveIndexEntry) * (archive_segmentRecords / archive_indexStride));
+	}
+
+	uint32_t count() const
+	{
+		return __atomic_load_n(&header()->count, __ATOMIC_ACQUIRE);
+	}
+
+private:
+	char *data = nullptr;
+	size_t size = 0;
+};
+
+// Appends events to the archive in a directory, starting a new segment
+// whenever the current one is full
+class EventArchive {
+public:
+	bool open(const std::string &directory)
+	{
+		dir = directory;
+		mkdir(dir.c_str(), 0755);
+		std::vector<std::string> names = archiveSegments(dir);
+		if (!names.empty())
+		{
+			sequence = strtoul(names.back().c_str(), nullptr, 10);
+			if (segment.open(dir + "/" + names.back(), true, false) &&
+			    segment.count() < archive_segmentRecords)
+				return true;
+		}
+		return nextSegment();
+	}
+
+	void append(int64_t timeUs, int stream, const std::string &streamName, const std::string &label,
+		    int frame, int count)
+	{
+		if (!segment.header())
+			return;
+		uint32_t n = segment.count();
+		if (n == archive_segmentRecords)
+		{
+			if (!nextSegment())
+				return;
+			n = 0;
+		}
+
+		ArchiveRecord &r = segment.records()[n];
+		memset(&r, 0, sizeof(r));
+		r.timeUs = timeUs;
+		r.frame = frame;
+		r.count = count;
+		r.stream = stream;
+		strncpy(r.streamName, streamName.c_str(), archive_nameSize - 1);
+		strncpy(r.label, label.c_str(), archive_nameSize - 1);
+
+		ArchiveIndexEntry &e = segment.index()[n / archive_indexStride];
+		ArchiveHeader *h = segment.header();
+		if (n % archive_indexStride == 0)
+		{
+			e.minUs = e.maxUs = timeUs;
+			e.streamMask = e.labelMask = 0;
+		}
+		e.minUs = std::min(e.minUs, timeUs);
+		e.maxUs = std::max(e.maxUs, timeUs);
+		e.streamMask |= archiveNameBit(r.streamName);
+		e.labelMask |= archiveNameBit(r.label);
+		h->minUs = n == 0 ? timeUs : std::min(h->minUs, timeUs);
+		h->maxUs = n == 0 ? timeUs : std::max(h->maxUs, timeUs);
+		__atomic_store_n(&h->count, n + 1, __ATOMIC_RELEASE);
+	}
+
+	void close()
+	{
+		segment.close();
+	}
+
+private:
+	std::string dir;
+	unsigned long sequence = 0;
+	ArchiveSegment segment;
+
+	bool nextSegment()
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "/%010lu.seg", ++sequence);
+		if (!segment.open(dir + name, true, true))
+		{
+			std::cout << "Could not create archive segment " << dir << name << std::endl;
+			return false;
+		}
+		return true;
+	}
+};
+
+// Read-only view of every segment of an archive
+class ArchiveReader {
+public:
+	bool open(const std::string &dir)
+	{
+		for (const std::string &name : archiveSegments(dir))
+		{
+			segments.emplace_back(new ArchiveSegment());
+			if (!segments.back()->open(dir + "/" + name, false, false))
+			{
+				std::cout << "Skipping unreadable archive segment " << dir << "/" << name << std::endl;
+				segments.pop_back();
+			}
+		}
+		return !segments.empty();
+	}
+
+	// Call fn for every record in [fromUs, toUs] of the given stream and label;
+	// an empty name matches all. Returns the number of records visited.
+	uint64_t query(int64_t fromUs, int64_t toUs, const std::string &stream, const std::string &label,
+		       const std::function<void(const ArchiveRecord &)> &fn) const
+	{
+		char streamName[archive_nameSize] = {0}, labelName[archive_nameSize] = {0};
+		strncpy(streamName, stream.c_str(), archive_nameSize - 1);
+		strncpy(labelName, label.c_str(), archive_nameSize - 1);
+		uint64_t streamBit = stream.empty() ? ~0ull : archiveNameBit(streamName);
+		uint64_t labelBit = label.empty() ? ~0ull : archiveNameBit(labelName);
+
+		uint64_t visited = 0;
+		for (auto &s : segments)
+		{
+			uint32_t count = s->count();
+			const ArchiveHeader *h = s->header();
+			if (count == 0 || h->maxUs < fromUs || h->minUs > toUs)
+				continue;
+			for (uint32_t b = 0; b * archive_indexStride < count; ++b)
+			{
+				const ArchiveIndexEntry &e = s->index()[b];
+				if (e.maxUs < fromUs || e.minUs > toUs || !(e.streamMask & streamBit) || !(e.labelMask & labelBit))
+					continue;
+				uint32_t end = std::min(count, (b + 1) * archive_indexStride);
+				for (uint32_t i = b * archive_indexStride; i < end; ++i)
+				{
+					const ArchiveRecord &r = s->records()[i];
+					++visited;
+					if (r.timeUs < fromUs || r.timeUs > toUs ||
+					    (!stream.empty() && strncmp(r.streamName, streamName, archive_nameSize) != 0) ||
+					    (!label.empty() && strncmp(r.label, labelName, archive_nameSize) != 0))
+						continue;
+					fn(r);
+				}
+			}
+		}
+		return visited;
+	}
+
+private:
+	std::vector<std::unique_ptr<ArchiveSegment>> segments;
+};
@@ -0,0 +1,371 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <nlohmann/json.hpp>
+
+#include <metrics.hpp>
+
+// Events per video kept for the snapshot sent to late joiners
+static const size_t live_snapshotEvents = 200;
+// Clients whose unsent output grows past this are disconnected
+static const size_t live_maxClientBacklog = 1 << 20;
+
+typedef struct {
+	std::string time;
+	std::string content;
+	float videoTime;
+	int count;
+} LiveEvent;
+
+// Server-Sent Events feed of detections for the browser UI. A single thread
+// runs an epoll loop over the listening socket, the clients and an eventfd
+// used by publish() to hand over new messages.
+class LiveFeed {
+public:
+	~LiveFeed()
+	{
+		stop();
+	}
+
+	bool start(int port)
+	{
+		listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+		if (listenFd < 0)
+			return false;
+		int one = 1;
+		setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+		sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (bind(listenFd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(listenFd, 16) < 0)
+		{
+			close(listenFd);
+			listenFd = -1;
+			return false;
+		}
+
+		wakeFd = eventfd(0, EFD_NONBLOCK);
+		epollFd = epoll_create1(0);
+		watch(listenFd, EPOLLIN);
+		watch(wakeFd, EPOLLIN);
+
+		running = true;
+		worker = std::thread(&LiveFeed::loop, this);
+		return true;
+	}
+
+	void stop()
+	{
+		if (!running)
+			return;
+		running = false;
+		wake();
+		if (worker.joinable())
+			worker.join();
+		for (auto &c : clients)
+			close(c.first);
+		clients.clear();
+		close(listenFd);
+		close(wakeFd);
+		close(epollFd);
+	}
+
+	// Queue a detection for every subscriber. Called from the inference thread;
+	// it only formats the message and hands it to the server thread.
+	void publish(const std::string &video, const LiveEvent &evt, const std::map<std::string, int> &labelTotals)
+	{
+		if (!running)
+			return;
+		nlohmann::json msg;
+		msg["video"] = video;
+		msg["time"] = evt.time;
+		msg["content"] = evt.content;
+		msg["videoTime"] = evt.videoTime;
+		msg["count"] = evt.count;
+		msg["labels"] = labelTotals;
+		{
+			std::lock_guard<std::mutex> lock(stateMutex);
+			VideoState &v = videos[video];
+			v.events.push_back(evt);
+			if (v.events.size() > live_snapshotEvents)
+				v.events.pop_front();
+			v.labels = labelTotals;
+			pending += "event: detection\ndata: " + msg.dump() + "\n\n";
+			metrics().queueDepth("live_pending", ++pendingEvents);
+		}
+		wake();
+	}
+
+private:
+	struct VideoState {
+		std::deque<LiveEvent> events;
+		std::map<std::string, int> labels;
+	};
+
+	struct Client {
+		std::string in;
+		std::string out;
+		bool subscribed = false;
+	};
+
+	int listenFd = -1;
+	int wakeFd = -1;
+	int epollFd = -1;
+	std::atomic<bool> running{false};
+	std::thread worker;
+	std::map<int, Client> clients;
+
+	std::mutex stateMutex;
+	std::map<std::string, VideoState> videos;
+	std::string pending;
+	int64_t pendingEvents = 0; // Messages in pending
+
+	void watch(int fd, uint32_t events)
+	{
+		epoll_event ev;
+		ev.events = events;
+		ev.data.fd = fd;
+		epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+	}
+
+	void wake()
+	{
+		uint64_t one = 1;
+		ssize_t n = write(wakeFd, &one, sizeof(one));
+		(void)n;
+	}
+
+	// Snapshot in the same shape as data.json and events.json, plus per-label
+	// totals. Called with stateMutex held.
+	std::string snapshot()
+	{
+		nlohmann::json data, events, labels;
+		data["totals"] = nlohmann::json::object();
+		for (auto &v : videos)
+		{
+			nlohmann::json counts = nlohmann::json::object(), evts = nlohmann::json::object();
+			int i = 0;
+			for (auto &e : v.second.events)
+			{
+				counts[std::to_string(e.videoTime)] = std::to_string(e.count);
+				evts[std::to_string(i++)] = {{"time", e.time}, {"content", e.content},
+					{"videoTime", std::to_string(e.videoTime)}};
+			}
+			data[v.first] = counts;
+			data["totals"][v.first] = v.second.events.empty() ? "0" :
+				std::to_string(v.second.events.back().count);
+			events[v.first] = evts;
+			labels[v.first] = v.second.labels;
+		}
+		nlohmann::json snap;
+		snap["data"] = data;
+		snap["events"] = events;
+		snap["labels"] = labels;
+		return "event: snapshot\ndata: " + snap.dump() + "\n\n";
+	}
+
+	void dropClient(int fd)
+	{
+		epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+		close(fd);
+		clients.erase(fd);
+	}
+
+	// Write as much buffered output as the socket takes, then wait for EPOLLOUT
+	void flush(int fd)
+	{
+		Client &c = clients[fd];
+		while (!c.out.empty())
+		{
+			ssize_t n = send(fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+			if (n > 0)
+			{
+				c.out.erase(0, n);
+				continue;
+			}
+			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				break;
+			dropClient(fd);
+			return;
+		}
+		epoll_event ev;
+		ev.events = EPOLLIN | (c.out.empty() ? 0 : EPOLLOUT);
+		ev.data.fd = fd;
+		epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev);
+	}
+
+	void acceptClients()
+	{
+		for (;;)
+		{
+			int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK);
+			if (fd < 0)
+				return;
+			clients[fd] = Client();
+			watch(fd, EPOLLIN);
+		}
+	}
+
+	void readRequest(int fd)
+	{
+		Client &c = clients[fd];
+		char buf[1024];
+		ssize_t n;
+		while ((n = recv(fd, buf, sizeof(buf), 0)) > 0)
+			c.in.append(buf, n);
+		if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) || c.in.size() > 8192)
+		{
+			dropClient(fd);
+			return;
+		}
+		if (c.subscribed || c.in.find("\r\n\r\n") == std::string::npos)
+			return;
+
+		if (c.in.compare(0, 11, "GET /events") == 0)
+		{
+			// Events still pending are already in the snapshot, so they go
+			// out to the existing subscribers before this one joins
+			std::string msgs, snap;
+			{
+				std::lock_guard<std::mutex> lock(stateMutex);
+				msgs.swap(pending);
+				takePending();
+				snap = snapshot();
+			}
+			deliver(msgs);
+			c.subscribed = true;
+			c.out = "HTTP/1.1 200 OK\r\n"
+				"Content-Type: text/event-stream\r\n"
+				"Cache-Control: no-cache\r\n"
+				"Access-Control-Allow-Origin: *\r\n"
+				"Connection: keep-alive\r\n\r\n" + snap;
+		}
+		else
+		{
+			c.out = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+		}
+		c.in.clear();
+		flush(fd);
+		if (clients.count(fd) && !clients[fd].subscribed && clients[fd].out.empty())
+			dropClient(fd);
+	}
+
+	void broadcast()
+	{
+		uint64_t count;
+		ssize_t n = read(wakeFd, &count, sizeof(count));
+		(void)n;
+
+		std::string msgs;
+		{
+			std::lock_guard<std::mutex> lock(stateMutex);
+			msgs.swap(pending);
+			takePending();
+		}
+		deliver(msgs);
+	}
+
+	// The pending messages were taken for delivery. Called with stateMutex held.
+	void takePending()
+	{
+		pendingEvents = 0;
+		metrics().queueDepth("live_pending", 0);
+	}
+
+	// Append messages to the output of every subscribed client
+	void deliver(const std::string &msgs)
+	{
+		if (msgs.empty())
+			return;
+
+		std::vector<int> fds;
+		for (auto &c : clients)
+			if (c.second.subscribed)
+				fds.push_back(c.first);
+		for (int fd : fds)
+		{
+			Client &c = clients[fd];
+			if (c.out.size() + msgs.size() > live_maxClientBacklog)
+			{
+				dropClient(fd);
+				continue;
+			}
+			c.out += msgs;
+			flush(fd);
+		}
+	}
+
+	void loop()
+	{
+		epoll_event events[32];
+		while (running)
+		{
+			int n = epoll_wait(epollFd, events, 32, -1);
+			for (int i = 0; i < n; ++i)
+			{
+				int fd = events[i].data.fd;
+				if (fd == listenFd)
+					acceptClients();
+				else if (fd == wakeFd)
+					broadcast();
+				else if (!clients.count(fd))
+					continue;
+				else if (events[i].events & (EPOLLHUP | EPOLLERR))
+					dropClient(fd);
+				else if (events[i].events & EPOLLOUT)
+					flush(fd);
+				else if (events[i].events & EPOLLIN)
+					readRequest(fd);
+			}
+
+			size_t backlog = 0;
+			for (auto &c : clients)
+				backlog = std::max(backlog, c.second.out.size());
+			metrics().gaugeSet(GAUGE_LIVE_BACKLOG, backlog);
+		}
+	}
+};
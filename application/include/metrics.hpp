@@ -0,0 +1,541 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+static const int metrics_maxStreams = 64;
+static const int metrics_maxLabels = 32;
+static const int metrics_maxShapes = 8;
+// A scraper that connects but stays silent is dropped after this long
+static const int metrics_clientTimeoutMs = 1000;
+
+// Pipeline stages timed by the latency histograms
+enum MetricStage {
+	STAGE_DECODE,
+	STAGE_PREPROCESS,
+	STAGE_INFER,
+	STAGE_POSTPROCESS,
+	STAGE_DISPLAY,
+	STAGE_WRITE,
+	STAGE_SNAPSHOT,
+	STAGE_COUNT
+};
+static const char *metricStageNames[STAGE_COUNT] = {
+	"decode", "preprocess", "infer", "postprocess", "display", "write", "snapshot"};
+
+// Point-in-time values, set from whichever thread owns the resource
+enum MetricGauge {
+	GAUGE_INFLIGHT,
+	GAUGE_LIVE_BACKLOG, // Largest unsent output of a live feed subscriber
+	GAUGE_COUNT
+};
+static const char *metricGaugeNames[GAUGE_COUNT] = {
+	"intruder_infer_requests_in_flight", "intruder_live_client_backlog_bytes"};
+
+// Upper bounds (in milliseconds) of the latency histogram buckets
+static const double metricBuckets[] = {0.5, 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000};
+static const int metricBucketCount = sizeof(metricBuckets) / sizeof(metricBuckets[0]);
+
+typedef std::chrono::high_resolution_clock::time_point MetricTime;
+
+// Counters owned by a single thread. Only the owner writes, so updates are a
+// relaxed load/store pair and never contend; the scraper only reads.
+struct MetricsShard {
+	std::atomic<uint64_t> framesDecoded[metrics_maxStreams];
+	std::atomic<uint64_t> framesSkipped[metrics_maxStreams];
+	std::atomic<uint64_t> framesInferred[metrics_maxStreams];
+	std::atomic<uint64_t> framesDropped[metrics_maxStreams];
+	std::atomic<uint64_t> events[metrics_maxLabels];
+	std::atomic<uint64_t> shapeFrames[metrics_maxShapes];
+	std::atomic<uint64_t> shapeDetections[metrics_maxShapes];
+	std::atomic<uint64_t> stageBuckets[STAGE_COUNT][metricBucketCount + 1];
+	std::atomic<uint64_t> stageCount[STAGE_COUNT];
+	std::atomic<uint64_t> stageSumUs[STAGE_COUNT];
+
+	MetricsShard()
+	{
+		for (int i = 0; i < metrics_maxStreams; ++i)
+		{
+			framesDecoded[i].store(0);
+			framesSkipped[i].store(0);
+			framesInferred[i].store(0);
+			framesDropped[i].store(0);
+		}
+		for (int i = 0; i < metrics_maxLabels; ++i)
+			events[i].store(0);
+		for (int i = 0; i < metrics_maxShapes; ++i)
+		{
+			shapeFrames[i].store(0);
+			shapeDetections[i].store(0);
+		}
+		for (int s = 0; s < STAGE_COUNT; ++s)
+		{
+			for (int b = 0; b <= metricBucketCount; ++b)
+				stageBuckets[s][b].store(0);
+			stageCount[s].store(0);
+			stageSumUs[s].store(0);
+		}
+	}
+
+	static void add(std::atomic<uint64_t> &c, uint64_t n)
+	{
+		c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+};
+
+class Metrics {
+public:
+	bool enabled = false;
+
+	// A stream takes the lowest free counter slot and gives it back when it
+	// is removed, so streams added over many config reloads never run out of
+	// the metrics_maxStreams slots. Returns -1 when all are taken. Both are
+	// called on the thread that counts the stream's frames.
+	int addStream(const std::string &name)
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		for (int i = 0; i < metrics_maxStreams; ++i)
+		{
+			if (!streamNames[i].empty())
+				continue;
+			streamNames[i] = name;
+			return i;
+		}
+		return -1;
+	}
+
+	// The stream leaves the scrape. Its counts so far become the base that a
+	// later stream in the same slot starts from.
+	void removeStream(int slot)
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		if (!validStream(slot))
+			return;
+		for (int m = 0; m < 4; ++m)
+			streamBase[slot][m] = streamTotal(m, slot);
+		streamNames[slot].clear();
+	}
+
+	// Labels get a counter slot the first time their name is seen and keep it
+	// across reloads, so that the count of a label never moves to another
+	// name when the label set changes
+	void setLabelNames(const std::vector<std::string> &names)
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		for (const std::string &name : names)
+			labelSlot(name);
+	}
+
+	// Name of a compiled network input shape, e.g. "992x544 U8"
+	void setShapeName(int id, const std::string &name)
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		if (id < 0 || id >= metrics_maxShapes)
+			return;
+		if (shapeNames.size() <= (size_t)id)
+			shapeNames.resize(id + 1);
+		shapeNames[id] = name;
+	}
+
+	// A frame inferred on the network for a shape, with its counted detections
+	void shapeInferred(int shape, uint64_t detections)
+	{
+		if (!enabled || shape < 0 || shape >= metrics_maxShapes)
+			return;
+		MetricsShard &s = shard();
+		MetricsShard::add(s.shapeFrames[shape], 1);
+		MetricsShard::add(s.shapeDetections[shape], detections);
+	}
+
+	void frameDecoded(int stream, uint64_t n = 1)
+	{
+		if (enabled && validStream(stream))
+			MetricsShard::add(shard().framesDecoded[stream], n);
+	}
+
+	void frameSkipped(int stream, uint64_t n = 1)
+	{
+		if (enabled && validStream(stream))
+			MetricsShard::add(shard().framesSkipped[stream], n);
+	}
+
+	void frameInferred(int stream)
+	{
+		if (enabled && validStream(stream))
+			MetricsShard::add(shard().framesInferred[stream], 1);
+	}
+
+	void frameDropped(int stream)
+	{
+		if (enabled && validStream(stream))
+			MetricsShard::add(shard().framesDropped[stream], 1);
+	}
+
+	void eventDetected(const std::string &label)
+	{
+		if (!enabled)
+			return;
+		int slot;
+		{
+			std::lock_guard<std::mutex> lock(registryMutex);
+			slot = labelSlot(label);
+		}
+		if (slot >= 0)
+			MetricsShard::add(shard().events[slot], 1);
+	}
+
+	void observe(MetricStage stage, double ms)
+	{
+		if (!enabled)
+			return;
+		MetricsShard &s = shard();
+		int b = 0;
+		while (b < metricBucketCount && ms > metricBuckets[b])
+			++b;
+		MetricsShard::add(s.stageBuckets[stage][b], 1);
+		MetricsShard::add(s.stageCount[stage], 1);
+		MetricsShard::add(s.stageSumUs[stage], (uint64_t)(ms * 1000.0));
+	}
+
+	// Records the time elapsed since start for the given stage
+	void observeSince(MetricStage stage, const MetricTime &start)
+	{
+		if (!enabled)
+			return;
+		std::chrono::duration<double, std::milli> d = std::chrono::high_resolution_clock::now() - start;
+		observe(stage, d.count());
+	}
+
+	void gaugeSet(MetricGauge g, int64_t v)
+	{
+		if (enabled)
+			gauges[g].store(v, std::memory_order_relaxed);
+	}
+
+	void gaugeAdd(MetricGauge g, int64_t v)
+	{
+		if (enabled)
+			gauges[g].fetch_add(v, std::memory_order_relaxed);
+	}
+
+	// Items waiting in a named hand-off between threads, updated by the
+	// thread that owns the queue: "live_pending" (events not yet sent to the
+	// live feed's subscribers), "mosaic" (frames waiting to be composed) and
+	// "streams_opening" (streams being opened in the background)
+	void queueDepth(const std::string &name, int64_t depth)
+	{
+		if (!enabled)
+			return;
+		std::lock_guard<std::mutex> lock(registryMutex);
+		queueDepths[name] = depth;
+	}
+
+	// Render every metric in the Prometheus text exposition format
+	std::string scrape()
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		std::ostringstream out;
+
+		const char *frameMetrics[] = {"decoded", "skipped", "inferred", "dropped"};
+		for (int m = 0; m < 4; ++m)
+		{
+			out << "# TYPE intruder_frames_" << frameMetrics[m] << "_total counter\n";
+			for (int i = 0; i < metrics_maxStreams; ++i)
+			{
+				if (streamNames[i].empty())
+					continue;
+				out << "intruder_frames_" << frameMetrics[m] << "_total{stream=\"" << streamNames[i]
+					<< "\"} " << streamTotal(m, i) - streamBase[i][m] << "\n";
+			}
+		}
+
+		out << "# TYPE intruder_events_total counter\n";
+		for (size_t i = 0; i < labelNames.size(); ++i)
+		{
+			uint64_t total = 0;
+			for (auto &s : shards)
+				total += s->events[i].load(std::memory_order_relaxed);
+			out << "intruder_events_total{label=\"" << labelNames[i] << "\"} " << total << "\n";
+		}
+
+		const char *shapeMetrics[] = {"frames", "detections"};
+		for (int m = 0; m < 2; ++m)
+		{
+			out << "# TYPE intruder_shape_" << shapeMetrics[m] << "_total counter\n";
+			for (size_t i = 0; i < shapeNames.size(); ++i)
+			{
+				uint64_t total = 0;
+				for (auto &s : shards)
+					total += (m == 0 ? s->shapeFrames[i] : s->shapeDetections[i]).load(std::memory_order_relaxed);
+				out << "intruder_shape_" << shapeMetrics[m] << "_total{shape=\"" << shapeNames[i]
+					<< "\"} " << total << "\n";
+			}
+		}
+
+		out << "# TYPE intruder_stage_latency_ms histogram\n";
+		for (int st = 0; st < STAGE_COUNT; ++st)
+		{
+			uint64_t cumulative = 0, count = 0, sumUs = 0;
+			for (int b = 0; b <= metricBucketCount; ++b)
+			{
+				for (auto &s : shards)
+					cumulative += s->stageBuckets[st][b].load(std::memory_order_relaxed);
+				out << "intruder_stage_latency_ms_bucket{stage=\"" << metricStageNames[st] << "\",le=\"";
+				if (b < metricBucketCount)
+					out << metricBuckets[b];
+				else
+					out << "+Inf";
+				out << "\"} " << cumulative << "\n";
+			}
+			for (auto &s : shards)
+			{
+				count += s->stageCount[st].load(std::memory_order_relaxed);
+				sumUs += s->stageSumUs[st].load(std::memory_order_relaxed);
+			}
+			out << "intruder_stage_latency_ms_sum{stage=\"" << metricStageNames[st] << "\"} "
+				<< sumUs / 1000.0 << "\n";
+			out << "intruder_stage_latency_ms_count{stage=\"" << metricStageNames[st] << "\"} "
+				<< count << "\n";
+		}
+
+		for (int g = 0; g < GAUGE_COUNT; ++g)
+		{
+			out << "# TYPE " << metricGaugeNames[g] << " gauge\n";
+			out << metricGaugeNames[g] << " " << gauges[g].load(std::memory_order_relaxed) << "\n";
+		}
+
+		out << "# TYPE intruder_queue_depth gauge\n";
+		for (auto &q : queueDepths)
+			out << "intruder_queue_depth{queue=\"" << q.first << "\"} " << q.second << "\n";
+
+		return out.str();
+	}
+
+	Metrics()
+	{
+		for (int g = 0; g < GAUGE_COUNT; ++g)
+			gauges[g].store(0);
+		memset(streamBase, 0, sizeof(streamBase));
+	}
+
+private:
+	std::mutex registryMutex;
+	std::list<std::unique_ptr<MetricsShard>> shards;
+	std::string streamNames[metrics_maxStreams]; // Empty for a free slot
+	uint64_t streamBase[metrics_maxStreams][4]; // Counts of the slot's earlier streams
+	std::vector<std::string> labelNames; // By slot
+	std::vector<std::string> shapeNames;
+	std::map<std::string, int64_t> queueDepths;
+	std::atomic<int64_t> gauges[GAUGE_COUNT];
+
+	static bool validStream(int stream)
+	{
+		return stream >= 0 && stream < metrics_maxStreams;
+	}
+
+	// Frames decoded, skipped, inferred or dropped (m = 0..3) in a stream
+	// slot since the start. Called with registryMutex held.
+	uint64_t streamTotal(int m, int slot)
+	{
+		uint64_t total = 0;
+		for (auto &s : shards)
+		{
+			std::atomic<uint64_t> *arr = m == 0 ? s->framesDecoded : m == 1 ? s->framesSkipped :
+				m == 2 ? s->framesInferred : s->framesDropped;
+			total += arr[slot].load(std::memory_order_relaxed);
+		}
+		return total;
+	}
+
+	// Slot of a label name, given on first sight; -1 once all are taken.
+	// Called with registryMutex held.
+	int labelSlot(const std::string &name)
+	{
+		for (size_t i = 0; i < labelNames.size(); ++i)
+			if (labelNames[i] == name)
+				return i;
+		if (labelNames.size() >= (size_t)metrics_maxLabels)
+			return -1;
+		labelNames.push_back(name);
+		return labelNames.size() - 1;
+	}
+
+	// The calling thread's shard. The registry lock is only taken the first
+	// time a thread records something.
+	MetricsShard &shard()
+	{
+		static thread_local MetricsShard *local = nullptr;
+		if (!local)
+		{
+			std::lock_guard<std::mutex> lock(registryMutex);
+			shards.emplace_back(new MetricsShard());
+			local = shards.back().get();
+		}
+		return *local;
+	}
+};
+
+inline Metrics &metrics()
+{
+	static Metrics instance;
+	return instance;
+}
+
+// Minimal HTTP listener serving /metrics on the loopback interface
+class MetricsServer {
+public:
+	~MetricsServer()
+	{
+		stop();
+	}
+
+	bool start(int port)
+	{
+		listenFd = socket(AF_INET, SOCK_STREAM, 0);
+		if (listenFd < 0)
+			return false;
+		int one = 1;
+		setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+		sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (bind(listenFd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(listenFd, 8) < 0)
+		{
+			close(listenFd);
+			listenFd = -1;
+			return false;
+		}
+		stopFd = eventfd(0, 0);
+		if (stopFd < 0)
+		{
+			close(listenFd);
+			listenFd = -1;
+			return false;
+		}
+
+		running = true;
+		worker = std::thread(&MetricsServer::serve, this);
+		return true;
+	}
+
+	void stop()
+	{
+		if (!running)
+			return;
+		running = false;
+		// The worker owns the sockets until it has been joined
+		uint64_t one = 1;
+		ssize_t n = write(stopFd, &one, sizeof(one));
+		(void)n;
+		if (worker.joinable())
+			worker.join();
+		close(listenFd);
+		close(stopFd);
+		listenFd = -1;
+		stopFd = -1;
+	}
+
+private:
+	int listenFd = -1;
+	int stopFd = -1; // eventfd written by stop() to wake the worker
+	std::atomic<bool> running{false};
+	std::thread worker;
+
+	void serve()
+	{
+		for (;;)
+		{
+			pollfd fds[2];
+			fds[0].fd = listenFd;
+			fds[0].events = POLLIN;
+			fds[1].fd = stopFd;
+			fds[1].events = POLLIN;
+			if (poll(fds, 2, -1) < 0)
+				continue;
+			if (fds[1].revents)
+				break;
+
+			int fd = accept(listenFd, nullptr, nullptr);
+			if (fd < 0)
+				continue;
+
+			timeval timeout;
+			timeout.tv_sec = metrics_clientTimeoutMs / 1000;
+			timeout.tv_usec = (metrics_clientTimeoutMs % 1000) * 1000;
+			setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+			setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+			char request[1024];
+			ssize_t n = recv(fd, request, sizeof(request) - 1, 0);
+			request[n > 0 ? n : 0] = '\0';
+
+			std::string response;
+			if (strncmp(request, "GET /metrics", 12) == 0)
+			{
+				std::string body = metrics().scrape();
+				response = "HTTP/1.0 200 OK\r\n"
+					"Content-Type: text/plain; version=0.0.4\r\n"
+					"Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+			}
+			else
+			{
+				response = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+			}
+
+			size_t sent = 0;
+			while (sent < response.size())
+			{
+				ssize_t w = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+				if (w <= 0)
+					break;
+				sent += w;
+			}
+			close(fd);
+		}
+	}
+};
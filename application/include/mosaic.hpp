@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "opencv2/highgui/highgui.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+
+#include <metrics.hpp>
+#include <trace.hpp>
+
+static const int mosaic_tileWidth = 480;
+static const int mosaic_tileHeight = 270;
+static const int mosaic_logWidth = 410;
+
+// Single window showing the latest annotated frame of every stream plus the
+// rolling log. Frames are handed over as they are; downscaling, composing
+// and showing the canvas all happen on its own thread at a fixed rate, so
+// neither the display nor the number of streams holds up inference.
+class Mosaic {
+public:
+	~Mosaic()
+	{
+		stop();
+	}
+
+	// names[i] is the name of stream i
+	void start(const std::vector<std::string> &names, double rate)
+	{
+		for (size_t i = 0; i < names.size(); ++i)
+			tiles[i].name = names[i];
+		period = std::chrono::microseconds((long)(1000000.0 / rate));
+		running = true;
+		worker = std::thread(&Mosaic::loop, this);
+	}
+
+	void stop()
+	{
+		if (!running)
+			return;
+		running = false;
+		if (worker.joinable())
+			worker.join();
+	}
+
+	// Streams added or removed while running; the grid is laid out again
+	void addStream(int stream, const std::string &name)
+	{
+		std::lock_guard<std::mutex> lock(tileMutex);
+		tiles[stream].name = name;
+	}
+
+	void removeStream(int stream)
+	{
+		std::lock_guard<std::mutex> lock(tileMutex);
+		tiles.erase(stream);
+	}
+
+	// Make frame the latest of a stream. Only the Mat header is kept, so the
+	// caller must not write to frame afterwards unless copy is set.
+	void submit(int stream, const cv::Mat &frame, bool copy = false)
+	{
+		cv::Mat held = copy ? frame.clone() : frame;
+		std::lock_guard<std::mutex> lock(tileMutex);
+		auto it = tiles.find(stream);
+		if (it != tiles.end())
+		{
+			it->second.frame = held;
+			it->second.fresh = true;
+		}
+	}
+
+	void setLog(const std::list<std::string> &lines)
+	{
+		std::lock_guard<std::mutex> lock(tileMutex);
+		logLines = lines;
+	}
+
+	// Set once Esc has been pressed in the mosaic window
+	bool exitRequested() const
+	{
+		return escPressed;
+	}
+
+private:
+	struct Tile {
+		std::string name;
+		cv::Mat frame;
+		bool fresh = false; // Submitted since the last compose
+	};
+
+	std::map<int, Tile> tiles; // By stream ID, laid out in that order
+	std::list<std::string> logLines;
+	std::mutex tileMutex;
+	std::chrono::microseconds period;
+	std::atomic<bool> running{false};
+	std::atomic<bool> escPressed{false};
+	std::thread worker;
+
+	void loop()
+	{
+		const char *window = "Intruder Detector";
+		cv::namedWindow(window, cv::WINDOW_AUTOSIZE);
+		tracer().nameThread("mosaic");
+
+		cv::Mat canvas;
+		std::map<int, cv::Mat> scaled; // Downscaled latest frame, by stream ID
+		std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+		while (running)
+		{
+			TraceTime composeStart = std::chrono::high_resolution_clock::now();
+			std::vector<Tile> latest;
+			std::vector<int> ids;
+			std::list<std::string> lines;
+			int waiting = 0;
+			{
+				// Only Mat headers are copied under the lock
+				std::lock_guard<std::mutex> lock(tileMutex);
+				for (auto &t : tiles)
+				{
+					latest.push_back(t.second);
+					ids.push_back(t.first);
+					waiting += t.second.fresh;
+					t.second.fresh = false;
+				}
+				lines = logLines;
+			}
+			metrics().queueDepth("mosaic", waiting);
+
+			// Only frames that arrived since the last tick are scaled again
+			std::map<int, cv::Mat> kept;
+			for (size_t i = 0; i < latest.size(); ++i)
+			{
+				cv::Mat &tile = kept[ids[i]];
+				if (!latest[i].fresh && scaled.count(ids[i]))
+				{
+					tile = scaled[ids[i]];
+					continue;
+				}
+				if (latest[i].frame.empty())
+					continue;
+				cv::resize(latest[i].frame, tile, cv::Size(mosaic_tileWidth, mosaic_tileHeight), 0, 0, cv::INTER_AREA);
+				if (tile.channels() == 1)
+					cv::cvtColor(tile, tile, cv::COLOR_GRAY2BGR);
+			}
+			scaled.swap(kept);
+
+			int cols = std::max(1, (int)std::ceil(std::sqrt((double)latest.size())));
+			int rows = std::max(1, ((int)latest.size() + cols - 1) / cols);
+			cv::Size size(cols * mosaic_tileWidth + mosaic_logWidth, std::max(rows * mosaic_tileHeight, 432));
+			if (canvas.size() != size)
+				canvas.create(size, CV_8UC3);
+			canvas.setTo(cv::Scalar(0, 0, 0));
+			for (size_t i = 0; i < latest.size(); ++i)
+			{
+				cv::Rect roi((i % cols) * mosaic_tileWidth, (i / cols) * mosaic_tileHeight,
+					mosaic_tileWidth, mosaic_tileHeight);
+				const cv::Mat &tile = scaled[ids[i]];
+				if (!tile.empty())
+					tile.copyTo(canvas(roi));
+				cv::putText(canvas, latest[i].name, cv::Point(roi.x + 10, roi.y + 20), cv::FONT_HERSHEY_SIMPLEX,
+					0.6, cv::Scalar(0, 255, 255), 1);
+			}
+
+			int line = 0;
+			for (auto &l : lines)
+			{
+				cv::putText(canvas, l, cv::Point(cols * mosaic_tileWidth + 10, 15 + 20 * line),
+					cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 1);
+				++line;
+			}
+			cv::imshow(window, canvas);
+			tracer().record("compose", composeStart, 0, -1);
+
+			if (cv::waitKey(1) == 27)
+				escPressed = true;
+
+			// Skip missed ticks rather than bursting to catch up
+			next += period;
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if (next < now)
+				next = now;
+			std::this_thread::sleep_until(next);
+		}
+		cv::destroyWindow(window);
+	}
+};
@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <ie_plugin_config.hpp>
+#include <inference_engine.hpp>
+#include <samples/ocv_common.hpp>
+#include <samples/slog.hpp>
+
+#include <detector.hpp>
+#include <preprocess.hpp>
+
+// SSD detector running on the OpenVINO Inference Engine. Two infer requests
+// are used in turn so a frame can be submitted while the previous one runs.
+class OpenVinoDetector : public Detector {
+public:
+	// inputHeight/inputWidth reshape the network before it is compiled; pass
+	// 0 to keep the resolution from the model's .xml. precision is the input
+	// blob precision, U8 or FP32. With a batchSize above 1 the device is asked
+	// for dynamic batching, so partly filled batches only cost their images.
+	OpenVinoDetector(InferenceEngine::Core &ie, const std::string &modelPath, const std::string &device,
+			 size_t batchSize, size_t inputHeight = 0, size_t inputWidth = 0,
+			 const std::string &precision = "U8")
+		: floatInput(precision == "FP32")
+		, batch(batchSize)
+	{
+		using namespace InferenceEngine;
+
+		if (precision != "U8" && precision != "FP32")
+			throw std::logic_error("Unsupported input precision " + precision + ", use U8 or FP32");
+
+		CNNNetwork network = ie.ReadNetwork(modelPath);
+		network.setBatchSize(batchSize);
+
+		if (inputHeight > 0 && inputWidth > 0)
+		{
+			ICNNNetwork::InputShapes shapes = network.getInputShapes();
+			for (auto &shape : shapes)
+			{
+				if (shape.second.size() == 4)
+				{
+					shape.second[2] = inputHeight;
+					shape.second[3] = inputWidth;
+				}
+			}
+			network.reshape(shapes);
+		}
+
+		InputsDataMap inputInfo(network.getInputsInfo());
+		for (const auto & inputInfoItem : inputInfo)
+		{
+			if (inputInfoItem.second->getInputData()->getTensorDesc().getDims().size() == 4)
+			{  // first input contains images
+				imageInputName = inputInfoItem.first;
+				inputInfoItem.second->setPrecision(floatInput ? Precision::FP32 : Precision::U8);
+				inputInfoItem.second->getInputData()->setLayout(Layout::NCHW);
+				const TensorDesc& inputDesc = inputInfoItem.second->getTensorDesc();
+				netInputHeight = getTensorHeight(inputDesc);
+				netInputWidth = getTensorWidth(inputDesc);
+				netInputChannel = getTensorChannels(inputDesc);
+			}
+			else if (inputInfoItem.second->getTensorDesc().getDims().size() == 2)
+			{  // second input contains image info
+				imageInfoInputName = inputInfoItem.first;
+				inputInfoItem.second->setPrecision(Precision::FP32);
+			}
+			else
+			{
+				throw std::logic_error("Unsupported " +
+						       std::to_string(inputInfoItem.second->getTensorDesc().getDims().size()) + "D "
+						       "input layer '" + inputInfoItem.first + "'. "
+						       "Only 2D and 4D input layers are supported");
+			}
+		}
+
+		OutputsDataMap outputInfo(network.getOutputsInfo());
+		if (outputInfo.size() != 1) {
+			throw std::logic_error("This demo accepts networks having only one output");
+		}
+		DataPtr& output = outputInfo.begin()->second;
+		outputName = outputInfo.begin()->first;
+
+		const SizeVector outputDims = output->getTensorDesc().getDims();
+		if (outputDims.size() != 4) {
+			throw std::logic_error("Incorrect output dimensions for SSD");
+		}
+		maxProposalCount = outputDims[2];
+		if (outputDims[3] != ssd_objectSize) {
+			throw std::logic_error("Output should have 7 as a last dimension");
+		}
+		output->setPrecision(Precision::FP32);
+		output->setLayout(Layout::NCHW);
+
+		name = std::to_string(netInputWidth) + "x" + std::to_string(netInputHeight) + " " + precision;
+		if (batch > 1)
+			name += " x" + std::to_string(batch);
+		slog::info << "Loading model to the device (" << name << ")" << slog::endl;
+		dynamicBatch = false;
+		if (batch > 1)
+		{
+			try
+			{
+				net = ie.LoadNetwork(network, device, {{PluginConfigParams::KEY_DYN_BATCH_ENABLED,
+					PluginConfigParams::YES}});
+				dynamicBatch = true;
+			}
+			catch (const std::exception &)
+			{
+				slog::info << "Dynamic batching not available, running full batches" << slog::endl;
+			}
+		}
+		if (!dynamicBatch)
+			net = ie.LoadNetwork(network, device);
+
+		for (int i = 0; i < 2; ++i)
+		{
+			requests[i] = net.CreateInferRequestPtr();
+			/* it's enough just to set image info input (if used in the model) only once */
+			if (!imageInfoInputName.empty())
+				setImgInfoBlob(requests[i]);
+		}
+	}
+
+	size_t inputWidth() const { return netInputWidth; }
+	size_t inputHeight() const { return netInputHeight; }
+	size_t inputChannels() const { return netInputChannel; }
+
+	size_t batchSize() const { return batch; }
+
+	// Input resolution stored in a model's .xml, before any reshape
+	static void modelInputSize(InferenceEngine::Core &ie, const std::string &modelPath, size_t *height, size_t *width)
+	{
+		InferenceEngine::CNNNetwork network = ie.ReadNetwork(modelPath);
+		for (auto &shape : network.getInputShapes())
+		{
+			if (shape.second.size() == 4)
+			{
+				*height = shape.second[2];
+				*width = shape.second[3];
+			}
+		}
+	}
+
+	void submit(const cv::Mat &frame)
+	{
+		submitBatch(std::vector<cv::Mat>(1, frame));
+	}
+
+	void submitBatch(const std::vector<cv::Mat> &images)
+	{
+		if (outstanding == 2)
+			throw std::logic_error("Both infer requests of " + name + " are busy");
+		if (images.empty() || images.size() > batch)
+			throw std::logic_error("Batch of " + std::to_string(images.size()) + " images for " + name);
+		InferenceEngine::InferRequest::Ptr &req = requests[(oldest + outstanding) % 2];
+		InferenceEngine::Blob::Ptr blob = req->GetBlob(imageInputName);
+		size_t imageSize = netInputWidth * netInputHeight * netInputChannel;
+		for (size_t i = 0; i < images.size(); ++i)
+		{
+			if (floatInput)
+				fillPlanar(images[i], blob->buffer().as<float *>() + i * imageSize,
+					   netInputWidth, netInputHeight, netInputChannel);
+			else
+				fillPlanar(images[i], blob->buffer().as<uint8_t *>() + i * imageSize,
+					   netInputWidth, netInputHeight, netInputChannel);
+		}
+		if (dynamicBatch)
+			req->SetBatch(images.size());
+		req->StartAsync();
+		++outstanding;
+	}
+
+	DetectStatus wait(DetectorResult *result)
+	{
+		using namespace InferenceEngine;
+
+		if (outstanding == 0)
+			return DETECT_NOT_STARTED;
+		InferRequest::Ptr &req = requests[oldest];
+		oldest = (oldest + 1) % 2;
+		--outstanding;
+
+		if (req->Wait(IInferRequest::WaitMode::RESULT_READY) != OK)
+			return DETECT_FAILED;
+		const float *box = req->GetBlob(outputName)->buffer().as<PrecisionTrait
+			<Precision::FP32>::value_type *>();
+		result->ssd.assign(box, box + maxProposalCount * ssd_objectSize);
+		parseSSD(box, maxProposalCount, &result->detections);
+		return DETECT_OK;
+	}
+
+private:
+	bool floatInput;
+	size_t batch;
+	bool dynamicBatch = false;
+	std::string imageInputName, imageInfoInputName, outputName;
+	size_t netInputHeight = 0, netInputWidth = 0, netInputChannel = 0;
+	int maxProposalCount = 0;
+	InferenceEngine::ExecutableNetwork net;
+	InferenceEngine::InferRequest::Ptr requests[2];
+	int oldest = 0;
+	int outstanding = 0;
+
+	void setImgInfoBlob(const InferenceEngine::InferRequest::Ptr &inferReq)
+	{
+		auto blob = inferReq->GetBlob(imageInfoInputName);
+		auto data = blob->buffer().as<InferenceEngine::PrecisionTrait<InferenceEngine::Precision::FP32>::value_type *>();
+		data[0] = static_cast<float>(netInputHeight);  // height
+		data[1] = static_cast<float>(netInputWidth);  // width
+		data[2] = 1;
+	}
+};
@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+#include <inference_engine.hpp>
+
+#include <config_watch.hpp>
+#include <detector.hpp>
+#include <event_archive.hpp>
+#include <live.hpp>
+#include <metrics.hpp>
+#include <mosaic.hpp>
+#include <recording.hpp>
+#include <videocap.hpp>
+
+// Settings of a Pipeline. The defaults match the intruder-detector command
+// line without options.
+struct PipelineOptions {
+	std::string configPath = conf_file;
+	std::string modelPath; // .xml of an SSD model; not needed with syntheticScript
+	std::string labelsPath;
+	std::string device = "CPU";
+	std::string syntheticScript; // Scripted detections instead of the model
+	bool async = true;
+	bool loop = false; // Restart video files when they end
+	bool ui = false; // Write the annotated videos for the browser UI
+	bool display = true; // Show OpenCV windows; off for headless embedding
+	double mosaicRate = 0; // Show one mosaic window at this rate instead of a window per stream
+	int metricsPort = 0;
+	int livePort = 0;
+	std::string recordPath;
+	std::string archivePath;
+	bool watchConfig = true; // Apply changes to the config file while running
+
+	// Files written next to the windows; each is skipped when left empty
+	std::string logPath; // Text log of the events
+	std::string snapshotDir; // A JPEG of the frame of every event
+	std::string uiDataDir; // events.json and data.json for the browser UI, on close
+	std::string uiVideoDir; // Annotated video of every stream, with ui
+};
+
+// Receives the results of a pipeline. Callbacks run on the thread calling
+// Pipeline::step() and should return quickly.
+class PipelineSink {
+public:
+	virtual ~PipelineSink() {}
+
+	// A frame was inferred and counted; frame has the boxes drawn on it
+	virtual void onFrame(const VideoCap &stream, const cv::Mat &frame, const std::vector<Detection> &detections) {}
+
+	// A new object of label was counted on stream
+	virtual void onEvent(const VideoCap &stream, const event &evt, const std::string &label) {}
+};
+
+// The intruder detector as an embeddable object: capture from every stream
+// in the config file, preprocess, inference, counting, and the outputs (log,
+// windows, UI files, metrics, live feed, recording, archive and sinks).
+//
+//   Pipeline pipeline(options);
+//   int err = pipeline.open();
+//   if (!err)
+//       err = pipeline.run();
+//   pipeline.close();
+//
+// Methods returning int return 0 or the exit code intruder-detector uses
+// for the failure.
+class Pipeline {
+public:
+	explicit Pipeline(const PipelineOptions &options);
+	~Pipeline();
+
+	// Open the streams, load the networks and start the enabled outputs
+	int open();
+
+	// Capture, infer and count one frame of every stream. Returns false once
+	// all streams have ended, stop() was called or Esc was pressed.
+	bool step();
+
+	// Call step() until it returns false
+	int run();
+
+	// Make step() return false; may be called from any thread
+	void stop();
+
+	// Stop the outputs, write the UI files and print throughput per network
+	void close();
+
+	// Sinks are not owned and must outlive the pipeline
+	void addSink(PipelineSink *sink);
+
+	const std::list<VideoCap> &streams() const { return vidCaps; }
+	const std::vector<std::string> &labels() const { return labelNames; }
+
+	// Stages of step(), for callers driving single streams themselves
+
+	// Read the next frame of a stream. Returns false if the stream has ended.
+	bool capture(VideoCap &vcap);
+
+	// Resize the frame to the network input, or cut it into tiles. Returns
+	// false if the result does not fit the network.
+	bool preprocess(VideoCap &vcap, std::vector<cv::Mat> *images);
+
+	// Submit the images and collect the frame that is due: the previous one
+	// in async mode, this one in sync mode
+	DetectStatus infer(VideoCap &vcap, const std::vector<cv::Mat> &images);
+
+	// Count the detections of the frame collected by infer() and feed every
+	// output. Takes the status infer() returned and does nothing unless it is
+	// DETECT_OK.
+	void postprocess(DetectStatus status);
+
+private:
+	PipelineOptions options;
+	std::atomic<bool> stopRequested{false};
+	int failure = 0;
+	bool started = false; // open() succeeded
+	bool closed = false;
+
+	InferenceEngine::Core ie;
+	std::map<std::string, std::shared_ptr<Detector>> detectors; // Networks in use, by key
+	size_t modelHeight = 0, modelWidth = 0;
+	std::list<VideoCap> vidCaps;
+	int minFPS = 240;
+
+	double threshold = conf_thresholdValue; // Detection confidence counted
+	int candidateConfidence = conf_candidateConfidence; // Frames a new count must hold
+	std::vector<bool> usedLabels; // Per label of the labels file
+	std::vector<int> labelPos; // Used label position in labels file
+	std::vector<std::string> labelNames;
+
+	// Frame submitted last in async mode, still in flight
+	Detector *prevDetector = nullptr;
+	VideoCap *prevVideoCap = nullptr;
+	uint64_t prevFrameId = 0;
+	cv::Mat prev_frame;
+
+	// Frame collected by infer(), for postprocess()
+	DetectorResult detResult;
+	Detector *doneDetector = nullptr;
+	VideoCap *doneVideoCap = nullptr;
+	uint64_t doneFrameId = 0;
+	cv::Mat done_frame;
+	double inferMs = 0;
+
+	std::ofstream logFile;
+	std::list<std::string> logList;
+	size_t rollingLogSize;
+	cv::Mat logs;
+	Mosaic mosaic;
+	Recorder recorder;
+	EventArchive archive;
+	MetricsServer metricsServer;
+	LiveFeed liveFeed;
+	std::vector<PipelineSink *> sinks;
+
+	// Streams added to the config file and being opened in the background
+	typedef struct {
+		std::list<VideoCap> vcap; // Empty if the stream could not be opened
+		std::string key; // Network the stream needs
+		std::shared_future<std::shared_ptr<Detector>> network; // Ready once compiled
+	} OpenedStream;
+
+	typedef struct {
+		std::string specKey;
+		bool cancelled; // Removed from the config file again before it was opened
+		std::future<OpenedStream> result;
+	} PendingStream;
+
+	ConfigWatcher configWatcher;
+	std::list<PendingStream> pendingStreams;
+	int nextStreamId = 0;
+
+	// Networks running or being compiled, by key. Streams opened at the same
+	// time that need the same new network wait for one compile.
+	std::mutex networksMutex;
+	std::map<std::string, std::shared_future<std::shared_ptr<Detector>>> networks;
+
+	std::chrono::high_resolution_clock::time_point start_time, run_start_time;
+
+	void initTiling(VideoCap &vcap);
+	std::string networkKey(const VideoCap &vcap, size_t *batch);
+	Detector *createDetector(const VideoCap &vcap, size_t batch);
+	OpenedStream openStream(StreamSpec spec, int streamId);
+	void applyConfigChanges();
+	void releaseNetworks();
+	void display();
+};
+
+// Read the model's label file and get the position of labels required by the application
+std::vector<bool> getUsedLabels(const std::string &labelsPath, std::vector<std::string> *reqLabels,
+				std::vector<int> *labelPos, std::vector<std::string> *labelNames);
+
+// Write events in the format of the browser UI's events.json and data.json
+void writeEventJSON(const std::deque<event> &events, double fps, std::ostream &evtJson, std::ostream &dataJson);
+
+// Write the video results to the browser UI's json files
+void saveJSON(const std::string &dir, const std::deque<event> &events, const VideoCap &vcap);
+
+// Feed a recording through SSD decoding, counting and the event output as
+// fast as possible. Event times come from the recording, so two builds
+// replaying the same file must produce identical intruders.log and JSON files.
+int replayRecording(const std::string &path, const PipelineOptions &options);
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+
+// Write a packed BGR image into a planar (CHW) input buffer of
+// width x height x channels elements of type T, resizing it first if needed.
+// The channels are split straight into the buffer, without a copy per pixel.
+template <typename T>
+inline void fillPlanar(const cv::Mat &image, T *dst, size_t width, size_t height, size_t channels)
+{
+	cv::Mat resized = image;
+	if ((size_t)image.cols != width || (size_t)image.rows != height)
+		cv::resize(image, resized, cv::Size(width, height));
+
+	const int depth = cv::DataType<T>::depth;
+	std::vector<cv::Mat> planes;
+	for (size_t c = 0; c < channels; ++c)
+		planes.push_back(cv::Mat(height, width, CV_MAKETYPE(depth, 1), dst + c * width * height));
+
+	if (resized.depth() != depth)
+		resized.convertTo(resized, CV_MAKETYPE(depth, resized.channels()));
+	// planes already have the right size and type, so split() writes into them
+	cv::split(resized, planes);
+}
@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <detector.hpp>
+
+// Recording of raw detector output, replayed through counting without video
+// or inference. Layout, little endian:
+//
+//   RecordingHeader
+//   RecordingStream[streamCount]
+//   int32_t labelPos[modelLabelCount]   position in usedLabels, -1 if unused
+//   char usedLabel[usedLabelCount][32]
+//   padding to 8 bytes
+//   repeated: RecordingFrame, then rows * 7 floats of SSD output
+//
+// Only the SSD rows before the terminating row are stored. The labels and
+// counting settings hold for the whole recording; the pipeline ends the
+// recording when a config reload changes them.
+
+static const char recording_magic[8] = {'I', 'D', 'R', 'E', 'C', 'O', 'R', 'D'};
+static const uint32_t recording_version = 2;
+// Version 1 headers end before threshold and were counted with the defaults
+static const size_t recording_v1HeaderSize = 32;
+static const size_t recording_nameSize = 32;
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t rowFloats;
+	uint32_t streamCount;
+	uint32_t modelLabelCount;
+	uint32_t usedLabelCount;
+	float threshold; // Detection confidence counted; 0 in version 1
+	uint32_t candidateConfidence; // Frames a new count must hold; 0 in version 1
+	uint32_t reserved;
+} RecordingHeader;
+
+typedef struct {
+	char name[recording_nameSize];
+	uint32_t width;
+	uint32_t height;
+	float fps;
+	uint32_t reserved;
+} RecordingStream;
+
+typedef struct {
+	uint32_t stream;
+	uint32_t rows;
+	uint64_t frame;  // Frame number within the stream, as in event.frame
+	int64_t timeUs;  // Wall clock time of the result, microseconds since the epoch
+} RecordingFrame;
+
+class Recorder {
+public:
+	~Recorder()
+	{
+		close();
+	}
+
+	bool open(const std::string &path, const std::vector<RecordingStream> &streams,
+		  const std::vector<int> &labelPos, const std::vector<std::string> &usedLabels,
+		  double threshold, int candidateConfidence)
+	{
+		file = fopen(path.c_str(), "wb");
+		if (!file)
+			return false;
+		setvbuf(file, nullptr, _IOFBF, 1 << 20);
+
+		RecordingHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, recording_magic, sizeof(header.magic));
+		header.version = recording_version;
+		header.rowFloats = ssd_objectSize;
+		header.streamCount = streams.size();
+		header.modelLabelCount = labelPos.size();
+		header.usedLabelCount = usedLabels.size();
+		header.threshold = threshold;
+		header.candidateConfidence = candidateConfidence;
+		fwrite(&header, sizeof(header), 1, file);
+		fwrite(streams.data(), sizeof(RecordingStream), streams.size(), file);
+		streamCount = streams.size();
+
+		size_t written = sizeof(header) + sizeof(RecordingStream) * streams.size();
+		for (int pos : labelPos)
+		{
+			int32_t p = pos;
+			fwrite(&p, sizeof(p), 1, file);
+			written += sizeof(p);
+		}
+		for (const std::string &label : usedLabels)
+		{
+			char name[recording_nameSize] = {0};
+			strncpy(name, label.c_str(), recording_nameSize - 1);
+			fwrite(name, recording_nameSize, 1, file);
+			written += recording_nameSize;
+		}
+		static const char zeros[8] = {0};
+		fwrite(zeros, 1, (8 - written % 8) % 8, file);
+		return true;
+	}
+
+	// Streams added after open() are not in the stream table and are skipped
+	void write(int stream, uint64_t frame, int64_t timeUs, const DetectorResult &result)
+	{
+		if (!file || stream < 0 || (size_t)stream >= streamCount)
+			return;
+		RecordingFrame rec;
+		rec.stream = stream;
+		rec.rows = result.detections.size();
+		rec.frame = frame;
+		rec.timeUs = timeUs;
+		fwrite(&rec, sizeof(rec), 1, file);
+		fwrite(result.ssd.data(), sizeof(float) * ssd_objectSize, rec.rows, file);
+	}
+
+	void close()
+	{
+		if (file)
+			fclose(file);
+		file = nullptr;
+	}
+
+	bool isOpen() const
+	{
+		return file != nullptr;
+	}
+
+private:
+	FILE *file = nullptr;
+	size_t streamCount = 0;
+};
+
+// Memory-mapped reader for a recording
+class RecordingReader {
+public:
+	RecordingHeader header;
+	std::vector<RecordingStream> streams;
+	std::vector<int> labelPos;
+	std::vector<std::string> usedLabels;
+
+	~RecordingReader()
+	{
+		if (data)
+			munmap((void *)data, size);
+	}
+
+	bool open(const std::string &path)
+	{
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) < 0 || (size_t)st.st_size < recording_v1HeaderSize)
+		{
+			::close(fd);
+			return false;
+		}
+		size = st.st_size;
+		void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (map == MAP_FAILED)
+			return false;
+		data = (const char *)map;
+		madvise(map, size, MADV_SEQUENTIAL);
+
+		memset(&header, 0, sizeof(header));
+		memcpy(&header, data, recording_v1HeaderSize);
+		if (memcmp(header.magic, recording_magic, sizeof(header.magic)) != 0 ||
+			(header.version != 1 && header.version != recording_version) ||
+			header.rowFloats != (uint32_t)ssd_objectSize)
+			return false;
+		size_t offset = recording_v1HeaderSize;
+		if (header.version == recording_version)
+		{
+			if (size < sizeof(header))
+				return false;
+			memcpy(&header, data, sizeof(header));
+			offset = sizeof(header);
+		}
+
+		size_t tables = sizeof(RecordingStream) * header.streamCount + sizeof(int32_t) * header.modelLabelCount +
+			recording_nameSize * header.usedLabelCount;
+		if (offset + tables > size)
+			return false;
+
+		streams.resize(header.streamCount);
+		memcpy(streams.data(), data + offset, sizeof(RecordingStream) * header.streamCount);
+		offset += sizeof(RecordingStream) * header.streamCount;
+		for (uint32_t i = 0; i < header.modelLabelCount; ++i)
+		{
+			int32_t p;
+			memcpy(&p, data + offset, sizeof(p));
+			labelPos.push_back(p);
+			offset += sizeof(p);
+		}
+		for (uint32_t i = 0; i < header.usedLabelCount; ++i)
+		{
+			usedLabels.push_back(std::string(data + offset, strnlen(data + offset, recording_nameSize)));
+			offset += recording_nameSize;
+		}
+		offset += (8 - offset % 8) % 8;
+		start = offset;
+		cursor = offset;
+		return true;
+	}
+
+	// Read the next frame; rows points into the mapping and stays valid while
+	// the reader is alive. Returns false at the end of the recording.
+	bool next(RecordingFrame *frame, const float **rows)
+	{
+		if (cursor + sizeof(RecordingFrame) > size)
+			return false;
+		memcpy(frame, data + cursor, sizeof(RecordingFrame));
+		size_t payload = sizeof(float) * ssd_objectSize * frame->rows;
+		if (cursor + sizeof(RecordingFrame) + payload > size || frame->stream >= header.streamCount)
+			return false;
+		*rows = (const float *)(data + cursor + sizeof(RecordingFrame));
+		cursor += sizeof(RecordingFrame) + payload;
+		return true;
+	}
+
+	void rewind()
+	{
+		cursor = start;
+	}
+
+private:
+	const char *data = nullptr;
+	size_t size = 0;
+	size_t start = 0;
+	size_t cursor = 0;
+};
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <deque>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include <detector.hpp>
+
+// Deterministic detector replaying scripted boxes, for exercising and timing
+// the pipeline without a model. The script is a JSON file of the form
+//
+//   {
+//     "latency_ms": 20,
+//     "input": [300, 300],
+//     "frames": [
+//       {"boxes": [[1, 0.9, 0.1, 0.1, 0.3, 0.6]]},
+//       {"boxes": []}
+//     ]
+//   }
+//
+// where each box is [label, confidence, xmin, ymin, xmax, ymax] with the
+// label numbered as in the model output. The n-th submitted image gets
+// frames[n % frames.size()], and each result becomes ready latency_ms after
+// it was submitted. A batch of images takes one script frame per image, with
+// the boxes of images[i] reported with image_id i.
+class SyntheticDetector : public Detector {
+public:
+	SyntheticDetector(const std::string &scriptPath)
+	{
+		std::ifstream file(scriptPath);
+		if (!file.is_open())
+			throw std::runtime_error("Could not open synthetic detector script " + scriptPath);
+		nlohmann::json script;
+		file >> script;
+
+		latency = std::chrono::microseconds((long)(script.value("latency_ms", 0.0) * 1000));
+		if (script.count("input"))
+		{
+			width = script["input"][0];
+			height = script["input"][1];
+		}
+		for (auto &f : script["frames"])
+		{
+			std::vector<float> rows;
+			for (auto &b : f["boxes"])
+			{
+				rows.push_back(0); // image_id
+				for (int i = 0; i < ssd_objectSize - 1; ++i)
+					rows.push_back(b[i]);
+			}
+			// Terminating row, as the SSD DetectionOutput layer emits
+			rows.push_back(-1);
+			rows.insert(rows.end(), ssd_objectSize - 1, 0.0f);
+			frames.push_back(rows);
+		}
+		if (frames.empty())
+			throw std::runtime_error("Synthetic detector script has no frames");
+		name = "synthetic " + std::to_string(width) + "x" + std::to_string(height);
+	}
+
+	size_t inputWidth() const { return width; }
+	size_t inputHeight() const { return height; }
+	size_t inputChannels() const { return 3; }
+
+	void submit(const cv::Mat &frame)
+	{
+		submitImages(1);
+	}
+
+	void submitBatch(const std::vector<cv::Mat> &images)
+	{
+		submitImages(images.size());
+	}
+
+	// Scripted batches can be of any size
+	size_t batchSize() const
+	{
+		return std::numeric_limits<size_t>::max();
+	}
+
+	DetectStatus wait(DetectorResult *result)
+	{
+		if (pending.empty())
+			return DETECT_NOT_STARTED;
+		Pending p = pending.front();
+		pending.pop_front();
+		std::this_thread::sleep_until(p.ready);
+
+		result->ssd.clear();
+		for (size_t i = 0; i < p.count; ++i)
+		{
+			const std::vector<float> &rows = frames[(p.index + i) % frames.size()];
+			// Every row but the terminating one, numbered with its image
+			for (size_t r = 0; r + ssd_objectSize < rows.size(); r += ssd_objectSize)
+			{
+				result->ssd.push_back(i);
+				result->ssd.insert(result->ssd.end(), rows.begin() + r + 1, rows.begin() + r + ssd_objectSize);
+			}
+		}
+		result->ssd.push_back(-1);
+		result->ssd.insert(result->ssd.end(), ssd_objectSize - 1, 0.0f);
+		parseSSD(result->ssd.data(), result->ssd.size() / ssd_objectSize, &result->detections);
+		return DETECT_OK;
+	}
+
+private:
+	struct Pending {
+		uint64_t index; // Script position of the first image
+		size_t count;
+		std::chrono::steady_clock::time_point ready;
+	};
+
+	void submitImages(size_t count)
+	{
+		Pending p;
+		p.index = submitted;
+		p.count = count;
+		p.ready = std::chrono::steady_clock::now() + latency;
+		pending.push_back(p);
+		submitted += count;
+	}
+
+	size_t width = 300;
+	size_t height = 300;
+	std::chrono::microseconds latency;
+	std::vector<std::vector<float>> frames;
+	std::deque<Pending> pending;
+	uint64_t submitted = 0;
+};
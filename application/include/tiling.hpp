@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+
+#include <detector.hpp>
+
+// Frames skipped between full refreshes when static tiles are skipped
+static const int tiling_refreshFrames = 30;
+// Mean absolute difference (gray levels) above which a tile has motion
+static const double tiling_motionThreshold = 4.0;
+// Overlap, as a fraction of the smaller box, above which boxes are merged
+static const float tiling_nmsThreshold = 0.5f;
+// Downscale factor of the frame used for motion detection
+static const int tiling_motionScale = 8;
+
+// Split a frame into tiles of the given size overlapping by at least
+// overlap (a fraction of the tile size). Tiles are spread evenly so the last
+// one ends at the frame border; a frame smaller than a tile gives one tile.
+inline std::vector<cv::Rect> makeTiles(cv::Size frame, cv::Size tile, float overlap)
+{
+	std::vector<int> xs, ys;
+	for (int d = 0; d < 2; ++d)
+	{
+		int length = d == 0 ? frame.width : frame.height;
+		int size = d == 0 ? tile.width : tile.height;
+		std::vector<int> &pos = d == 0 ? xs : ys;
+		if (length <= size)
+		{
+			pos.push_back(0);
+			continue;
+		}
+		float stride = size * (1.0f - overlap);
+		int n = (int)std::ceil((length - size) / stride) + 1;
+		for (int i = 0; i < n; ++i)
+			pos.push_back((int)std::lround((double)i * (length - size) / (n - 1)));
+	}
+
+	std::vector<cv::Rect> tiles;
+	for (int y : ys)
+		for (int x : xs)
+			tiles.push_back(cv::Rect(x, y, tile.width, tile.height) & cv::Rect(0, 0, frame.width, frame.height));
+	return tiles;
+}
+
+// Greedy per-label non-maximum suppression. Boxes are compared by their
+// intersection over the smaller box, so an object cut in two by a tile seam
+// is merged with the full detection from the neighbouring tile.
+inline void suppressOverlaps(std::vector<Detection> *detections, float threshold)
+{
+	std::sort(detections->begin(), detections->end(), [](const Detection &a, const Detection &b) {
+		return a.confidence > b.confidence;
+	});
+
+	std::vector<Detection> kept;
+	for (const Detection &d : *detections)
+	{
+		bool suppressed = false;
+		for (const Detection &k : kept)
+		{
+			if (k.label != d.label)
+				continue;
+			float iw = std::min(d.xmax, k.xmax) - std::max(d.xmin, k.xmin);
+			float ih = std::min(d.ymax, k.ymax) - std::max(d.ymin, k.ymin);
+			if (iw <= 0 || ih <= 0)
+				continue;
+			float smaller = std::min((d.xmax - d.xmin) * (d.ymax - d.ymin), (k.xmax - k.xmin) * (k.ymax - k.ymin));
+			if (smaller > 0 && iw * ih / smaller > threshold)
+			{
+				suppressed = true;
+				break;
+			}
+		}
+		if (!suppressed)
+			kept.push_back(d);
+	}
+	detections->swap(kept);
+}
+
+// Re-encode detections as SSD rows, with a terminating row
+inline void toSSD(const std::vector<Detection> &detections, std::vector<float> *ssd)
+{
+	ssd->clear();
+	for (const Detection &d : detections)
+	{
+		float row[ssd_objectSize] = {(float)d.imageId, (float)(d.label + 1), d.confidence,
+			d.xmin, d.ymin, d.xmax, d.ymax};
+		ssd->insert(ssd->end(), row, row + ssd_objectSize);
+	}
+	ssd->push_back(-1);
+	ssd->insert(ssd->end(), ssd_objectSize - 1, 0.0f);
+}
+
+// Tiled inference state of one stream. Tiles are cut at the network input
+// size so distant objects keep their native resolution.
+class TileState {
+public:
+	bool enabled = false;
+	float overlap = 0.2f;
+	bool skipStatic = false;
+	std::vector<cv::Rect> tiles;
+
+	void init(cv::Size frame, cv::Size tile)
+	{
+		frameSize = frame;
+		tiles = makeTiles(frame, tile, overlap);
+		cache = std::vector<std::vector<Detection>>(tiles.size());
+	}
+
+	// Choose the tiles to infer for this frame and remember them until the
+	// result comes back. Without skipping every tile is chosen; otherwise
+	// only tiles that changed since the previous frame, at least one, and
+	// all of them every tiling_refreshFrames frames.
+	std::vector<int> select(const cv::Mat &frame)
+	{
+		std::vector<int> chosen;
+		if (!skipStatic)
+		{
+			for (size_t i = 0; i < tiles.size(); ++i)
+				chosen.push_back(i);
+			pending.push_back(chosen);
+			return chosen;
+		}
+
+		cv::Mat small;
+		cv::resize(frame, small, cv::Size(frame.cols / tiling_motionScale, frame.rows / tiling_motionScale),
+			0, 0, cv::INTER_AREA);
+		if (small.channels() == 3)
+			cv::cvtColor(small, small, cv::COLOR_BGR2GRAY);
+
+		bool refresh = lastSmall.empty() || lastSmall.size() != small.size() || ++sinceRefresh >= tiling_refreshFrames;
+		int busiest = 0;
+		double busiestScore = -1;
+		for (size_t i = 0; i < tiles.size(); ++i)
+		{
+			if (refresh)
+			{
+				chosen.push_back(i);
+				continue;
+			}
+			cv::Rect r(tiles[i].x / tiling_motionScale, tiles[i].y / tiling_motionScale,
+				std::max(1, tiles[i].width / tiling_motionScale), std::max(1, tiles[i].height / tiling_motionScale));
+			r &= cv::Rect(0, 0, small.cols, small.rows);
+			cv::Mat diff;
+			cv::absdiff(small(r), lastSmall(r), diff);
+			double score = cv::mean(diff)[0];
+			if (score > tiling_motionThreshold)
+				chosen.push_back(i);
+			if (score > busiestScore)
+			{
+				busiestScore = score;
+				busiest = i;
+			}
+		}
+		if (chosen.empty())
+			chosen.push_back(busiest);
+		if (refresh)
+			sinceRefresh = 0;
+		lastSmall = small;
+		pending.push_back(chosen);
+		return chosen;
+	}
+
+	// Turn the batched result for the oldest pending frame into detections
+	// relative to the whole frame. Tiles skipped for that frame reuse their
+	// last detections. Boxes below minConfidence are dropped before merging.
+	void merge(const std::vector<Detection> &batch, float minConfidence, std::vector<Detection> *out)
+	{
+		out->clear();
+		if (pending.empty())
+			return;
+		std::vector<int> chosen = pending.front();
+		pending.pop_front();
+
+		for (int t : chosen)
+			cache[t].clear();
+		for (const Detection &d : batch)
+		{
+			if (d.imageId < 0 || d.imageId >= (int)chosen.size() || d.confidence <= minConfidence)
+				continue;
+			int t = chosen[d.imageId];
+			const cv::Rect &r = tiles[t];
+			Detection m = d;
+			m.imageId = 0;
+			m.xmin = (r.x + d.xmin * r.width) / frameSize.width;
+			m.ymin = (r.y + d.ymin * r.height) / frameSize.height;
+			m.xmax = (r.x + d.xmax * r.width) / frameSize.width;
+			m.ymax = (r.y + d.ymax * r.height) / frameSize.height;
+			cache[t].push_back(m);
+		}
+
+		for (const std::vector<Detection> &c : cache)
+			out->insert(out->end(), c.begin(), c.end());
+		suppressOverlaps(out, tiling_nmsThreshold);
+	}
+
+	// Forget the oldest pending frame when its inference failed
+	void drop()
+	{
+		if (!pending.empty())
+			pending.pop_front();
+	}
+
+private:
+	cv::Size frameSize;
+	std::vector<std::vector<Detection>> cache;
+	std::deque<std::vector<int>> pending;
+	cv::Mat lastSmall;
+	int sinceRefresh = 0;
+};
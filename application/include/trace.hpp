@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Number of spans kept per thread; older spans are overwritten
+static const size_t trace_bufferSize = 1 << 16;
+
+typedef std::chrono::high_resolution_clock::time_point TraceTime;
+
+// A completed stage of a frame. name must point to a string literal.
+struct TraceSpan {
+	const char *name;
+	uint64_t frameId;
+	int stream;
+	int64_t startUs;
+	int64_t durUs;
+};
+
+// Ring slot guarded by a sequence number: odd while its owner writes it,
+// 2 * (span index + 1) once span index is complete. Readers copy the fields
+// and keep the copy only if the sequence is unchanged afterwards.
+struct TraceSlot {
+	std::atomic<uint64_t> seq;
+	std::atomic<const char *> name;
+	std::atomic<uint64_t> frameId;
+	std::atomic<int> stream;
+	std::atomic<int64_t> startUs;
+	std::atomic<int64_t> durUs;
+};
+
+// Ring of spans written by a single thread. The writer publishes each slot
+// through its sequence number and bumps head, so recording never locks.
+struct TraceBuffer {
+	std::vector<TraceSlot> spans;
+	std::atomic<uint64_t> head;
+	long tid;
+	std::atomic<const char *> threadName;
+
+	TraceBuffer()
+		: spans(trace_bufferSize)
+		, head(0)
+		, tid(syscall(SYS_gettid))
+		, threadName("worker") {}
+};
+
+class Tracer {
+public:
+	bool enabled = false;
+	std::string outputPath;
+
+	Tracer()
+		: origin(std::chrono::high_resolution_clock::now())
+		, dumpRequested(false)
+		, nextFrame(0) {}
+
+	// Hand out a new frame ID at capture time
+	uint64_t newFrame()
+	{
+		if (!enabled)
+			return 0;
+		return nextFrame.fetch_add(1, std::memory_order_relaxed) + 1;
+	}
+
+	// Record a span from start until now
+	void record(const char *name, const TraceTime &start, uint64_t frameId, int stream)
+	{
+		if (!enabled)
+			return;
+		TraceTime end = std::chrono::high_resolution_clock::now();
+		TraceBuffer &b = buffer();
+		uint64_t h = b.head.load(std::memory_order_relaxed);
+		TraceSlot &s = b.spans[h % trace_bufferSize];
+		s.seq.store(2 * h + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		s.name.store(name, std::memory_order_relaxed);
+		s.frameId.store(frameId, std::memory_order_relaxed);
+		s.stream.store(stream, std::memory_order_relaxed);
+		s.startUs.store(std::chrono::duration_cast<std::chrono::microseconds>(start - origin).count(),
+			std::memory_order_relaxed);
+		s.durUs.store(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count(),
+			std::memory_order_relaxed);
+		s.seq.store(2 * h + 2, std::memory_order_release);
+		b.head.store(h + 1, std::memory_order_release);
+	}
+
+	// Label the calling thread in the trace viewer
+	void nameThread(const char *name)
+	{
+		if (enabled)
+			buffer().threadName.store(name, std::memory_order_relaxed);
+	}
+
+	void setStreamName(int id, const std::string &name)
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		if (streamNames.size() <= (size_t)id)
+			streamNames.resize(id + 1);
+		streamNames[id] = name;
+	}
+
+	// Safe to call from a signal handler; the dump itself happens in poll()
+	void requestDump()
+	{
+		dumpRequested.store(true, std::memory_order_relaxed);
+	}
+
+	// Write the trace if a dump was requested since the last call
+	void poll()
+	{
+		if (enabled && dumpRequested.exchange(false, std::memory_order_relaxed))
+			dump();
+	}
+
+	// Copy span index of a buffer. Returns false if the slot was overwritten,
+	// or is being written, by its owner thread during the copy.
+	static bool readSpan(const TraceBuffer &b, uint64_t index, TraceSpan *span)
+	{
+		const TraceSlot &s = b.spans[index % trace_bufferSize];
+		uint64_t seq = s.seq.load(std::memory_order_acquire);
+		if (seq != 2 * index + 2)
+			return false;
+		span->name = s.name.load(std::memory_order_relaxed);
+		span->frameId = s.frameId.load(std::memory_order_relaxed);
+		span->stream = s.stream.load(std::memory_order_relaxed);
+		span->startUs = s.startUs.load(std::memory_order_relaxed);
+		span->durUs = s.durUs.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return s.seq.load(std::memory_order_relaxed) == seq;
+	}
+
+	// Write every buffered span as Chrome Trace Event JSON. Other threads
+	// may keep recording; spans they overwrite meanwhile are left out.
+	bool dump()
+	{
+		if (!enabled)
+			return false;
+		std::ofstream out(outputPath);
+		if (!out.is_open())
+		{
+			std::cout << "Could not write trace file " << outputPath << std::endl;
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(registryMutex);
+		out << "{\"traceEvents\":[\n";
+		bool first = true;
+		for (auto &b : buffers)
+		{
+			out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+				<< b->tid << ",\"args\":{\"name\":\"" << b->threadName.load(std::memory_order_relaxed) << "\"}}";
+			first = false;
+
+			uint64_t h = b->head.load(std::memory_order_acquire);
+			uint64_t begin = h > trace_bufferSize ? h - trace_bufferSize : 0;
+			TraceSpan s;
+			for (uint64_t i = begin; i < h; ++i)
+			{
+				if (!readSpan(*b, i, &s))
+					continue;
+				out << ",\n{\"name\":\"" << s.name << "\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+					<< b->tid << ",\"ts\":" << s.startUs << ",\"dur\":" << s.durUs
+					<< ",\"args\":{\"frame\":" << s.frameId;
+				if (s.stream >= 0 && (size_t)s.stream < streamNames.size())
+					out << ",\"stream\":\"" << streamNames[s.stream] << "\"";
+				out << "}}";
+			}
+		}
+		out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+		std::cout << "Trace written to " << outputPath << std::endl;
+		return true;
+	}
+
+private:
+	TraceTime origin;
+	std::atomic<bool> dumpRequested;
+	std::atomic<uint64_t> nextFrame;
+	std::mutex registryMutex;
+	std::list<std::unique_ptr<TraceBuffer>> buffers;
+	std::vector<std::string> streamNames;
+
+	// The calling thread's buffer, registered on its first span
+	TraceBuffer &buffer()
+	{
+		static thread_local TraceBuffer *local = nullptr;
+		if (!local)
+		{
+			std::lock_guard<std::mutex> lock(registryMutex);
+			buffers.emplace_back(new TraceBuffer());
+			local = buffers.back().get();
+		}
+		return *local;
+	}
+};
+
+inline Tracer &tracer()
+{
+	static Tracer instance;
+	return instance;
+}
+
+inline void traceSignalHandler(int)
+{
+	tracer().requestDump();
+}
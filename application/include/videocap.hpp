@@ -23,28 +23,32 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <deque>
 #include <string>
 #include <vector>
 #include "opencv2/highgui/highgui.hpp"
 
+#include <tiling.hpp>
+
 using namespace std;
 
-static string conf_targetDevice;
-static string conf_modelPath;
-static string conf_binFilePath;
-static string conf_labelsFilePath;
+class Detector;
+
 static const string conf_file = "../resources/config.json";
 static const size_t conf_batchSize = 1;
 static const int conf_windowColumns = 2; // OpenCV windows per each row
 const int displayWindowWidth = 768;
 const int displayWindowHeight = 432;
-bool loopVideos = false;
 
 static const int conf_fourcc = 0x31637661;
 
+// Counting defaults; a Pipeline uses the values of its config file
 static const double conf_thresholdValue = 0.55;
 static const int conf_candidateConfidence = 4;
-static std::vector<std::string> acceptedDevices{"CPU", "GPU", "MYRIAD", "HETERO:FPGA,CPU", "HDDL"};
+// Events kept in memory per stream for the UI; older ones are only in the log and the archive
+static const size_t conf_recentEvents = 1000;
 
 typedef struct {
 	char time[25];
@@ -69,53 +73,54 @@ public:
 	vector<int> candidateConfidence;
 
 	vector<string> labelName;
-	vector<event> events;
+	deque<event> events; // The last conf_recentEvents events
 	cv::VideoCapture vc;
 	cv::VideoWriter vw;
 
 	int frameCount = 0;
 	int loopFrames = 0;
 	bool isCam = false;
+	int streamId = 0; // Unique within a run, never reused after a reload
+	int metricsSlot = -1; // Counters of the stream, see Metrics::addStream()
+	uint64_t frameId = 0; // Trace ID of the last captured frame
+	double fps = 0;
+	bool ended = false; // No more frames to read
+	bool draining = false; // Removed from the config, waiting to be closed
+	string specKey; // Identifies the stream across config reloads
+
+	// Network input for this stream; 0 keeps the model's own resolution
+	size_t netHeight = 0;
+	size_t netWidth = 0;
+	string netPrecision = "U8";
+	Detector *detector = nullptr;
+	TileState tiling;
 
 	const string camName;
-	const string videoName;
+	string videoName; // Annotated video for the browser UI, written by initVW()
 
+	// Stream without a capture device, fed from a recording
 	VideoCap(size_t inputWidth,
 			 size_t inputHeight,
-			 const string inputVideo,
-			 const string camName,
-			 int number)
+			 double fps,
+			 const string camName)
 		: inputWidth(inputWidth)
 		, inputHeight(inputHeight)
-		, inputVideo(inputVideo)
-		, vc(inputVideo.c_str())
-		, frame()
-		, camName(camName)
-		, videoName("../UI/resources/videos/video" + to_string(number+1) + ".mp4") {
-			if (!vc.isOpened())
-			{
-				std::cout << "Couldn't open video " << inputVideo << std::endl;
-				exit(1);
-			}
-		}
+		, inputVideo("replay")
+		, fps(fps)
+		, camName(camName) {}
 
-	VideoCap(size_t inputWidth,
-			 size_t inputHeight,
-			 const int inputVideo,
-			 const string camName,
-			 int number)
-		: inputWidth(inputWidth)
-		, inputHeight(inputHeight)
-		, inputVideo("stream")
-		, vc(inputVideo)
-		, camName(camName)
-		, videoName("../UI/resources/videos/video" + to_string(number+1) + ".mp4") {
-			if (!vc.isOpened())
-			{
-				std::cout << "Couldn't open video " << inputVideo << std::endl;
-				exit(1);
-			}
-			isCam = true;
+	// Stream whose capture was opened beforehand, e.g. on a background thread
+	VideoCap(const cv::VideoCapture &opened,
+			 const string inputVideo,
+			 bool isCam,
+			 const string camName)
+		: inputWidth(0)
+		, inputHeight(0)
+		, inputVideo(inputVideo)
+		, vc(opened)
+		, isCam(isCam)
+		, camName(camName) {
+			fps = vc.get(cv::CAP_PROP_FPS);
 		}
 
 	void init (int size)
@@ -130,12 +135,28 @@ public:
 		labelName = vector<string>(size);
 	}
 
-	int initVW(int height, int width)
+	// Carry the counting state over to a new label set; labels are matched by
+	// name and new labels start from zero
+	void remapLabels(const vector<string> &oldNames, const vector<string> &newNames)
 	{
-		vw.open(videoName, conf_fourcc, vc.get(cv::CAP_PROP_FPS), cv::Size(width, height), true);
-		if (!vw.isOpened())
+		vector<int> oldLast = lastCorrectCount, oldTotal = totalCount;
+		vector<int> oldCandidate = candidateCount, oldConfidence = candidateConfidence;
+		init(newNames.size());
+		for (size_t i = 0; i < newNames.size(); ++i)
 		{
-			return 1;
+			size_t j = find(oldNames.begin(), oldNames.end(), newNames[i]) - oldNames.begin();
+			if (j >= oldNames.size() || j >= oldTotal.size())
+				continue;
+			lastCorrectCount[i] = oldLast[j];
+			totalCount[i] = oldTotal[j];
+			candidateCount[i] = oldCandidate[j];
+			candidateConfidence[i] = oldConfidence[j];
 		}
 	}
+
+	bool initVW(int height, int width)
+	{
+		vw.open(videoName, conf_fourcc, vc.get(cv::CAP_PROP_FPS), cv::Size(width, height), true);
+		return vw.isOpened();
+	}
 };
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// Query tool for the event archive written by intruder-detector -ar DIR
+
+#include <iostream>
+#include <chrono>
+#include <climits>
+#include <ctime>
+#include <map>
+#include <string>
+#include <utility>
+
+#include <event_archive.hpp>
+
+using namespace std;
+
+string archiveDir;
+string streamName;
+string labelName;
+int64_t fromUs = LLONG_MIN;
+int64_t toUs = LLONG_MAX;
+bool listEvents = false;
+
+
+// Parse "YYYY-MM-DD HH:MM[:SS]", or "HH:MM[:SS]" for today, in local time
+bool parseTime(const string &text, int64_t *us)
+{
+	time_t now = time(nullptr);
+	tm today = *localtime(&now);
+	today.tm_sec = 0;
+	// A failed strptime may have filled in some fields, so each format starts over
+	tm when = today;
+	const char *end = strptime(text.c_str(), "%Y-%m-%d %H:%M", &when);
+	if (!end)
+	{
+		when = today;
+		end = strptime(text.c_str(), "%H:%M", &when);
+	}
+	if (!end)
+		return false;
+	if (*end == ':')
+		end = strptime(end + 1, "%S", &when);
+	if (!end || *end)
+		return false;
+	when.tm_isdst = -1;
+	*us = (int64_t)mktime(&when) * 1000000;
+	return true;
+}
+
+
+// Parse the command line argument
+void parseArgs(int argc, char **argv)
+{
+	if (argc < 2 || "-h" == string(argv[1]) || "--help" == string(argv[1]))
+	{
+		cout << argv[0] << " DIR [OPTIONS]\n\n"
+					"Count the events in the archive DIR written with intruder-detector -ar DIR, per stream and label\n\n"
+					"-f, --from	Only events at or after this time, as \"YYYY-MM-DD HH:MM[:SS]\" or \"HH:MM[:SS]\" for today\n"
+					"-t, --to	Only events at or before this time, in the same format\n"
+					"-s, --stream	Only events of this stream, e.g. \"Cam 3\"\n"
+					"-l, --label	Only events of this label\n"
+					"-e, --events	List the matching events as well, using true. Default option is false\n";
+		exit(0);
+	}
+
+	archiveDir = argv[1];
+	for (int i = 2; i + 1 < argc; i += 2)
+	{
+		string arg = argv[i];
+		if (("-f" == arg || "--from" == arg) && !parseTime(argv[i + 1], &fromUs))
+		{
+			cout << "Could not parse time " << argv[i + 1] << endl;
+			exit(12);
+		}
+		if (("-t" == arg || "--to" == arg) && !parseTime(argv[i + 1], &toUs))
+		{
+			cout << "Could not parse time " << argv[i + 1] << endl;
+			exit(12);
+		}
+		if ("-s" == arg || "--stream" == arg)
+			streamName = argv[i + 1];
+		if ("-l" == arg || "--label" == arg)
+			labelName = argv[i + 1];
+		if ("-e" == arg || "--events" == arg)
+			listEvents = string(argv[i + 1]) == "true";
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	parseArgs(argc, argv);
+
+	ArchiveReader reader;
+	if (!reader.open(archiveDir))
+	{
+		cout << "No archive segments in " << archiveDir << endl;
+		return 2;
+	}
+
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	// Streams are told apart by ID and name, as a name alone may have been
+	// given to another stream by a recording or an earlier version
+	map<pair<int, string>, map<string, uint64_t>> counts; // (stream ID, name) -> label -> events
+	uint64_t matched = 0;
+	uint64_t visited = reader.query(fromUs, toUs, streamName, labelName, [&](const ArchiveRecord &r)
+	{
+		string stream(r.streamName, strnlen(r.streamName, archive_nameSize));
+		string label(r.label, strnlen(r.label, archive_nameSize));
+		++counts[make_pair(r.stream, stream)][label];
+		++matched;
+		if (listEvents)
+		{
+			time_t t = r.timeUs / 1000000;
+			char when[32];
+			strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&t));
+			cout << when << " - Intruder " << label << " detected on " << stream << " (frame " << r.frame << ")\n";
+		}
+	});
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+	for (auto &stream : counts)
+	{
+		cout << stream.first.second << " (stream " << stream.first.first << ")\n";
+		for (auto &label : stream.second)
+			cout << "\t" << label.first << "\t" << label.second << "\n";
+	}
+	cout << matched << " events, " << visited << " records read in " << elapsed.count() << " ms" << endl;
+	return 0;
+}
@@ -22,36 +22,27 @@
  */
 
 #include <iostream>
-#include <fstream>
 #include <algorithm>
-#include <ctime>
-#include <chrono>
-
-#include "opencv2/opencv.hpp"
-#include "opencv2/photo/photo.hpp"
-#include "opencv2/highgui/highgui.hpp"
-#include "opencv2/video/video.hpp"
-
-#include <ie_icnn_net_reader.h>
-//#include <ie_device.hpp>
-#include <ie_plugin_config.hpp>
-#include <ie_plugin_dispatcher.hpp>
-#include <ie_plugin_ptr.hpp>
-#include <inference_engine.hpp>
-#include <samples/ocv_common.hpp>
-#include <samples/slog.hpp>
-//#include <ie_extension.h>
-//#include <ext_list.hpp>
-#include <nlohmann/json.hpp>
-#include <videocap.hpp>
-
-using namespace cv;
-using namespace InferenceEngine::details;
-using namespace InferenceEngine;
+#include <csignal>
+
+#include <pipeline.hpp>
+#include <trace.hpp>
+
+string conf_targetDevice;
+string conf_modelPath;
+string conf_binFilePath;
+string conf_labelsFilePath;
+string conf_syntheticScript;
+bool loopVideos = false;
+std::vector<std::string> acceptedDevices{"CPU", "GPU", "MYRIAD", "HETERO:FPGA,CPU", "HDDL"};
 bool isAsyncMode = true;
 bool isUI = false;
-using json = nlohmann::json;
-json jsonobj;
+int metricsPort = 0;
+int livePort = 0;
+double mosaicRate = 0;
+string recordPath;
+string replayPath;
+string archivePath;
 
 // Parse the environmental variables
 void parseEnv()
@@ -85,7 +76,15 @@ void parseArgs(int argc, char **argv)
 							" To run on multiple devices, use MULTI:<device1>,<device2>,<device3>\n"
 					"-f, --flag	execution on SYNC or ASYNC mode. Default option is ASYNC mode\n"
 					"-ui, --ui	Enable the Browser UI using true. Default option is false\n"
-					"-lp, --loop	Loop video to mimic continuous input\n";
+					"-lp, --loop	Loop video to mimic continuous input\n"
+					"-mp, --metrics_port	Serve Prometheus metrics on 127.0.0.1:PORT/metrics. Disabled by default\n"
+					"-tr, --trace	Record per-frame stage timings to a Chrome trace file, written on exit or SIGUSR1\n"
+					"-lv, --live	Push detections to the browser UI as Server-Sent Events on 127.0.0.1:PORT/events\n"
+					"-ms, --mosaic	Show all streams and the log in one window refreshed HZ times a second\n"
+					"-sy, --synthetic	Replace the model with scripted detections from a JSON file, for benchmarking\n"
+					"-rc, --record	Record the raw detector output of every stream to FILE\n"
+					"-rp, --replay	Run the counting and event output on a recording at full speed, without video or inference\n"
+					"-ar, --archive	Store every event in the binary archive in DIR, for queries with intruder-archive\n";
 		exit(0);
 	}
 
@@ -130,6 +129,39 @@ void parseArgs(int argc, char **argv)
 			else
 				isUI = false;
 		}
+		if ("-mp" == std::string(argv[i]) || "--metrics_port" == std::string(argv[i]))
+		{
+			metricsPort = std::stoi(argv[i + 1]);
+		}
+		if ("-tr" == std::string(argv[i]) || "--trace" == std::string(argv[i]))
+		{
+			tracer().enabled = true;
+			tracer().outputPath = std::string(argv[i + 1]);
+		}
+		if ("-lv" == std::string(argv[i]) || "--live" == std::string(argv[i]))
+		{
+			livePort = std::stoi(argv[i + 1]);
+		}
+		if ("-ms" == std::string(argv[i]) || "--mosaic" == std::string(argv[i]))
+		{
+			mosaicRate = std::stod(argv[i + 1]);
+		}
+		if ("-sy" == std::string(argv[i]) || "--synthetic" == std::string(argv[i]))
+		{
+			conf_syntheticScript = std::string(argv[i + 1]);
+		}
+		if ("-rc" == std::string(argv[i]) || "--record" == std::string(argv[i]))
+		{
+			recordPath = std::string(argv[i + 1]);
+		}
+		if ("-rp" == std::string(argv[i]) || "--replay" == std::string(argv[i]))
+		{
+			replayPath = std::string(argv[i + 1]);
+		}
+		if ("-ar" == std::string(argv[i]) || "--archive" == std::string(argv[i]))
+		{
+			archivePath = std::string(argv[i + 1]);
+		}
 	}
 }
 
@@ -137,7 +169,11 @@ void parseArgs(int argc, char **argv)
 // Validate the command line arguments
 void checkArgs()
 {
-	if (conf_modelPath.empty())
+	// A recording carries its own streams and labels
+	if (!replayPath.empty())
+		return;
+
+	if (conf_modelPath.empty() && conf_syntheticScript.empty())
 	{
 		std::cout << "You need to specify the path to the .xml file\n";
 		std::cout << "Use -m MODEL or --model MODEL\n";
@@ -166,607 +202,41 @@ void checkArgs()
 }
 
 
-// Read the model's label file and get the position of labels required by the application
-static std::vector<bool> getUsedLabels(std::vector<string> *reqLabels, std::vector<int> *labelPos,
-                                                std::vector<string> *labelNames)
-{
-	std::vector<bool> usedLabels;
-
-	std::ifstream labelsFile(conf_labelsFilePath);
-
-	if (!labelsFile.is_open())
-	{
-		std::cout << "Could not open labels file" << std::endl;
-		return usedLabels;
-	}
-
-	std::string label;
-	int i = 0;
-	while (getline(labelsFile, label))
-	{
-		if (std::find((*reqLabels).begin(), (*reqLabels).end(), label) != (*reqLabels).end())
-		{
-			usedLabels.push_back(true);
-			(*labelPos).push_back(i);
-			(*labelNames).push_back(label);
-			++i;
-		}
-		else
-		{
-			usedLabels.push_back(false);
-			(*labelPos).push_back(0);
-		}
-	}
-
-	labelsFile.close();
-
-	return usedLabels;
-}
-
-
-// Parse the configuration file conf.txt
-std::vector<VideoCap> getInput(std::ifstream *file, size_t width, size_t height, vector<string> *usedLabels)
-{
-	std::vector<VideoCap> streams;
-	std::string str;
-	int cams = 0;
-	char camName[20];
-	*file>>jsonobj;
-	auto obj = jsonobj["inputs"];
-	for(int i=0;i<obj.size();i++)
-	{
-		auto label = obj[i]["label"];
-		auto path = obj[i]["video"];
-
-		for(int j = 0;j<path.size();j++)
-		{
-			sprintf(camName, "Cam %d", j+1);
-			string file_path = path[j];
-			if (file_path.size() == 1 && *(file_path.c_str()) >= '0' && *(file_path.c_str()) <= '9')
-			{
-				streams.push_back(VideoCap(width, height, std::stoi(file_path), camName, cams));
-			}
-			else
-			{
-				streams.push_back(VideoCap(width, height, file_path, camName, cams));
-			}
-		}
-		for(int j = 0;j<label.size();j++)
-		{
-			(*usedLabels).push_back(label[j]);
-
-		}
-	}
-
-	for (int i = 0; i < streams.size(); ++i)
-	{
-		streams[i].init((*usedLabels).size());
-	}
-
-	return streams;
-}
-
-
-// Get the minimum fps of the videos
-int get_minFPS(std::vector<VideoCap> &vidCaps)
-{
-	int minFPS = 240;
-
-	for (auto &&i : vidCaps)
-	{
-		minFPS = std::min(minFPS, (int)round(i.vc.get(CAP_PROP_FPS)));
-	}
-
-	return minFPS;
-}
-
-
-// Arranges the windows so that they are not overlapping
-void arrangeWindows(vector<VideoCap> *vidCaps, size_t width, size_t height)
-{
-	int spacer = 470;
-	int rowSpacer = 250;
-	int cols = 0;
-	int rows = 0;
-
-	namedWindow("Intruder Log", WINDOW_AUTOSIZE);
-	moveWindow("Intruder Log", 0, 0);
-
-	for (int i = 0; i < (*vidCaps).size(); ++i)
-	{
-		namedWindow((*vidCaps)[i].camName, WINDOW_NORMAL);
-		resizeWindow((*vidCaps)[i].camName, displayWindowWidth, displayWindowHeight);
-
-		if (cols == conf_windowColumns)
-		{
-			cols = 1;
-			++rows;
-			moveWindow((*vidCaps)[i].camName, spacer * cols, rowSpacer * rows);
-		}
-		else
-		{
-			++cols;
-			moveWindow((*vidCaps)[i].camName, spacer * cols, rowSpacer * rows);
-		}
-	}
-}
-
-
-// Write the video results to json files
-void saveJSON(vector<event> events, VideoCap vcap)
-{
-
-	ofstream evtJson("../UI/resources/video_data/events.json");
-	if (!evtJson.is_open())
-	{
-		cout << "Could not create JSON file" << endl;
-		return;
-	}
-
-	ofstream dataJson("../UI/resources/video_data/data.json");
-	if (!dataJson.is_open())
-	{
-		cout << "Could not create JSON file" << endl;
-		return;
-	}
-
-	int total;
-
-	evtJson << "{\n\t\"video1\": {\n";
-	dataJson << "{\n\t\"video1\": {\n";
-	if (!events.empty())
-	{
-		int fps = vcap.vc.get(cv::CAP_PROP_FPS);
-		int evts = static_cast<int>(events.size());
-		int i = 0;
-		for (; i < evts - 1; ++i)
-		{
-			evtJson << "\t\t\"" << i << "\":{\n";
-			evtJson << "\t\t\t\"time\":\"" << events[i].time << "\",\n";
-			evtJson << "\t\t\t\"content\":\"" << events[i].intruder << "\",\n";
-			evtJson << "\t\t\t\"videoTime\":\"" << (float)events[i].frame / fps << "\"\n";
-			evtJson << "\t\t},\n";
-
-			dataJson << "\t\t\"" << (float)events[i].frame / fps << "\": \"" << events[i].count << "\",\n";
-		}
-
-		evtJson << "\t\t\"" << i << "\":{\n";
-		evtJson << "\t\t\t\"time\":\"" << events[i].time << "\",\n";
-		evtJson << "\t\t\t\"content\":\"" << events[i].intruder << "\",\n";
-		evtJson << "\t\t\t\"videoTime\":\"" << (float)events[i].frame / fps << "\"\n";
-		evtJson << "\t\t}\n";
-
-		dataJson << "\t\t\"" << (float)events[i].frame / fps << "\": \"" << events[i].count << "\"\n";
-		total = events[i].count;
-	}
-	evtJson << "\t}\n";
-	evtJson << "}";
-
-	dataJson << "\t},\n";
-	dataJson << "\t\"totals\":{\n";
-	dataJson << "\t\t\"video1\": \"" << total << "\"\n";
-	dataJson << "\t}\n";
-	dataJson << "}";
-}
-
-
-
 int main(int argc, char **argv)
 {
-	int logWinHeight = 432;
-	int logWinWidth = 410;
-	std::vector<bool> noMoreData;
 	parseEnv();
 	parseArgs(argc, argv);
 	checkArgs();
-	std::ifstream confFile(conf_file);
-	if (!confFile.is_open())
-	{
-		cout << "Could not open config file" << endl;
-		return 2;
-	}
-
-	// Inference engine initialization
-	Core ie;
-
-	auto network = ie.ReadNetwork(conf_modelPath);
-
-        network.setBatchSize(conf_batchSize);
-
-	// if ((conf_targetDevice.find("CPU") != std::string::npos))
-	// {
-		// Required for support of certain layers in CPU
-		//ie.AddExtension(std::make_shared<Extensions::Cpu::CpuExtensions>(), "CPU");
-	// }
-
-	InputsDataMap inputInfo(network.getInputsInfo());
-
-	std::string imageInputName, imageInfoInputName;
-	size_t netInputHeight, netInputWidth, netInputChannel;
-
-	for (const auto & inputInfoItem : inputInfo)
-	{
-	if (inputInfoItem.second->getInputData()->getTensorDesc().getDims().size() == 4)
-	{  // first input contains images
-	    imageInputName = inputInfoItem.first;
-	    inputInfoItem.second->setPrecision(Precision::U8);
-	    inputInfoItem.second->getInputData()->setLayout(Layout::NCHW);
-	    const TensorDesc& inputDesc = inputInfoItem.second->getTensorDesc();
-	    netInputHeight = getTensorHeight(inputDesc);
-	    netInputWidth = getTensorWidth(inputDesc);
-	    netInputChannel = getTensorChannels(inputDesc);
-	}
-	else if (inputInfoItem.second->getTensorDesc().getDims().size() == 2)
-	{  // second input contains image info
-	    imageInfoInputName = inputInfoItem.first;
-	    inputInfoItem.second->setPrecision(Precision::FP32);
-	}
-	else
-	{
-	    throw std::logic_error("Unsupported " +
-		                   std::to_string(inputInfoItem.second->getTensorDesc().getDims().size()) + "D "
-		                   "input layer '" + inputInfoItem.first + "'. "
-		                   "Only 2D and 4D input layers are supported");
-	}
-	}
-
-	OutputsDataMap outputInfo(network.getOutputsInfo());
-	if (outputInfo.size() != 1) {
-	throw std::logic_error("This demo accepts networks having only one output");
-	}
-	DataPtr& output = outputInfo.begin()->second;
-	auto outputName = outputInfo.begin()->first;
-
-	const SizeVector outputDims = output->getTensorDesc().getDims();
-	const int maxProposalCount = outputDims[2];
-
-	const int objectSize = outputDims[3];
-	if (objectSize != 7) {
-	throw std::logic_error("Output should have 7 as a last dimension");
-	}
-	if (outputDims.size() != 4) {
-	throw std::logic_error("Incorrect output dimensions for SSD");
-	}
-	output->setPrecision(Precision::FP32);
-	output->setLayout(Layout::NCHW);
-	// -----------------------------------------------------------------------------------------------------
-
-	// --------------------------- 4. Loading model to the device ------------------------------------------
-	slog::info << "Loading model to the device" << slog::endl;
-	ExecutableNetwork net = ie.LoadNetwork(network, conf_targetDevice);
-	// -----------------------------------------------------------------------------------------------------
-
-	// --------------------------- 5. Create infer request -------------------------------------------------
-	InferenceEngine::InferRequest::Ptr currInfReq = net.CreateInferRequestPtr();
-	InferenceEngine::InferRequest::Ptr nextInfReq = net.CreateInferRequestPtr();
-
-	// ----------------------
-	// get output dimensions
-	// ----------------------
-	/* it's enough just to set image info input (if used in the model) only once */
-	if (!imageInfoInputName.empty())
-	{
-	auto setImgInfoBlob = [&](const InferRequest::Ptr &inferReq) {
-	    auto blob = inferReq->GetBlob(imageInfoInputName);
-	    auto data = blob->buffer().as<PrecisionTrait<Precision::FP32>::value_type *>();
-	    data[0] = static_cast<float>(netInputHeight);  // height
-	    data[1] = static_cast<float>(netInputWidth);  // width
-	    data[2] = 1;
-	};
-	setImgInfoBlob(currInfReq);
-	setImgInfoBlob(nextInfReq);
-	}
-
-	// Create VideoCap objects for all the videos and camera
-	std::vector<VideoCap> vidCaps;
-
-	// Requested labels 
-	std::vector<string> reqLabels;
-	vidCaps = getInput(&confFile, netInputWidth, netInputHeight, &reqLabels);
-
-	const size_t output_width = netInputWidth;
-	const size_t output_height = netInputHeight;
-
-	// Initializing VideoWriter for each source 
-	for (auto &vidCapObj : vidCaps)
-	{
-		vidCapObj.inputWidth = vidCapObj.vc.get(cv::CAP_PROP_FRAME_WIDTH);
-		vidCapObj.inputHeight = vidCapObj.vc.get(cv::CAP_PROP_FRAME_HEIGHT);
-		if(isUI  && !(loopVideos))
-		if (!(vidCapObj.initVW(vidCapObj.inputHeight, vidCapObj.inputWidth)))
-		{
-			cout << "Could not open " << vidCapObj.videoName << " for writing\n";
-			return 4;
-		}
-		noMoreData.push_back(false);
-	}
-
-	Mat logs;
-	arrangeWindows(&vidCaps, output_width, output_height);
-
-	Mat frameInfer, prev_frame, frame, output_frames;
-
-	auto input_channels = netInputChannel; // Channels for color format, RGB=4
-	auto channel_size = output_width * output_height;
-	auto input_size = channel_size * input_channels;
-
-	// Read class names
-	vector<int> labelPos; // used label position in labels file
-	vector<string> labelNames;
-	std::vector<bool> usedLabels = getUsedLabels(&reqLabels, &labelPos, &labelNames);
-	if (usedLabels.empty())
-	{
-		std::cout<< "Error: No labels currently in use. Please edit conf.txt file"<< std::endl;
-		return 1;
-	}
-
-	ofstream logFile("intruders.log");
-	if (!logFile.is_open())
-	{
-		cout << "Could not create log file\n";
-		return 3;
-	}
-
-	list<string> logList;
-	int rollingLogSize = (logWinHeight - 15) / 20;
-	int index = 0;
-	int totalCount = 0;
-	std::chrono::high_resolution_clock::time_point start_time = std::chrono::high_resolution_clock::now();
-
-	int minFPS = get_minFPS(vidCaps);
-	int waitTime = 1;
-	if(isAsyncMode)
-		std::cout<<"Application runnning in Async mode"<<std::endl;
-	else
-		std::cout<<"Application runnning in sync mode"<<std::endl;
-
-	VideoCap *prevVideoCap;
-	typedef std::chrono::duration<double,std::ratio<1, 1000>> ms;
-
-	// Main loop starts here
-	for (;;)
-	{
-		index = 0;
-		for (auto &vidCapObj : vidCaps)
-		{
-			//---------------------------
-			// Get a new frame
-			//---------------------------
-			int vfps = (int)round(vidCapObj.vc.get(CAP_PROP_FPS));
-			for (int i = 0; i < round(vfps / minFPS); ++i)
-			{
-				vidCapObj.vc.read(frame);
-				vidCapObj.loopFrames++;
-				vidCapObj.frame = frame;
-			}
-			if (!frame.data)
-			{
-				noMoreData[index] = true;
-			}
-			if (noMoreData[index])
-			{
-				++index;
-				Mat messageWindow = Mat(displayWindowHeight, displayWindowWidth, CV_8UC1, Scalar(0));
-				std::string message = "Video stream from " + vidCapObj.camName + " has ended!";
-				cv::putText(messageWindow, message, Point((250), displayWindowHeight/2), 
-						cv::FONT_HERSHEY_COMPLEX, 0.5, (255, 255, 255), 1);
-				imshow(vidCapObj.camName, messageWindow);
-				continue;
-			}
-			Blob::Ptr inputBlob;
-			//---------------------------------------------
-			// Resize to expected size (in model .xml file)
-			//---------------------------------------------
-
-			// Input frame is resized to infer resolution
-
-			resize(frame, output_frames, Size(output_width, output_height));
-			frameInfer = output_frames;
-			if(isAsyncMode)
-			{
-				inputBlob = nextInfReq->GetBlob(imageInputName);
-			}
-			else
-			{
-				inputBlob = currInfReq->GetBlob(imageInputName);
-				prevVideoCap = &vidCapObj;
-				prev_frame = vidCapObj.frame;
-			}
-			matU8ToBlob<uint8_t>(output_frames, inputBlob);
-
-			//----------------------------------------------------
-			// PREPROCESS STAGE:
-			// convert image to format expected by inference engine
-			// IE expects planar, convert from packed
-			//----------------------------------------------------
-			size_t framesize = frameInfer.rows * frameInfer.step1();
-
-			if (framesize != input_size)
-			{
-				std::cout << "input pixels mismatch, expecting "
-							<< input_size << " bytes, got: " << framesize
-							<< endl;
-				return 1;
-			}
-
-			//---------------------------
-			// INFER STAGE
-			//---------------------------
-			std::chrono::high_resolution_clock::time_point infer_start_time = std::chrono::high_resolution_clock::now();
-			if(isAsyncMode)
-				nextInfReq->StartAsync();
-			else
-				currInfReq->StartAsync();
-			std::chrono::high_resolution_clock::time_point infer_stop_time = std::chrono::high_resolution_clock::now();
-			ms infer_time = std::chrono::duration_cast<ms>(infer_stop_time - infer_start_time);
-			if(OK == currInfReq->Wait(IInferRequest::WaitMode::RESULT_READY))
-			{
-				//---------------------------
-				// POSTPROCESS STAGE:
-				// Parse output
-				//---------------------------
-				float *box = currInfReq->GetBlob(outputName)->buffer().as<InferenceEngine::PrecisionTrait
-				    <InferenceEngine::Precision::FP32>::value_type *>();
-
-				for (int i = 0; i < vidCapObj.noLabels; ++i)
-				{
-					prevVideoCap->currentCount[i] = 0;
-					prevVideoCap->changedCount[i] = false;
-				}
-
-				//---------------------------
-				// Parse SSD output
-				//---------------------------
-				for (int c = 0; c < maxProposalCount; c++)
-				{
-					float *localbox = &box[c * 7];
-					float image_id = localbox[0];
-					float label = localbox[1] - 1;
-					float confidence = localbox[2];
-					int labelnum = (int)label;
-					if ((confidence > conf_thresholdValue) && usedLabels[labelnum])
-					{
-
-						int pos = labelPos[labelnum];
-						prevVideoCap->currentCount[pos]++;
-
-						float xmin = localbox[3] * prevVideoCap->inputWidth;
-						float ymin = localbox[4] * prevVideoCap->inputHeight;
-						float xmax = localbox[5] * prevVideoCap->inputWidth;
-						float ymax = localbox[6] * prevVideoCap->inputHeight;
-
-						char tmplabel[32];
-						rectangle(prev_frame, Point((int)xmin, (int)ymin), Point((int)xmax, (int)ymax),
-									Scalar(0, 255, 0), 4, LINE_AA, 0);
-					}
-				}
-
-				for (int i = 0; i < prevVideoCap->noLabels; ++i)
-				{
-					if (prevVideoCap->candidateCount[i] == prevVideoCap->currentCount[i])
-						prevVideoCap->candidateConfidence[i]++;
-					else
-					{
-						prevVideoCap->candidateConfidence[i] = 0;
-						prevVideoCap->candidateCount[i] = prevVideoCap->currentCount[i];
-					}
-
-					if (prevVideoCap->candidateConfidence[i] == conf_candidateConfidence)
-					{
-						prevVideoCap->candidateConfidence[i] = 0;
-						prevVideoCap->changedCount[i] = true;
-					}
-					else
-						continue;
-
-					if (prevVideoCap->currentCount[i] > prevVideoCap->lastCorrectCount[i])
-					{
-						prevVideoCap->totalCount[i] += prevVideoCap->currentCount[i] -
-							prevVideoCap->lastCorrectCount[i];
-						time_t t = time(nullptr);
-						tm *currTime = localtime(&t);
-						int detObj = prevVideoCap->currentCount[i] - prevVideoCap->lastCorrectCount[i];
-						char str[50];
-						for (int j = 0; j < detObj; ++j)
-						{
-							totalCount = 0;
-							for(auto cnt : prevVideoCap->totalCount)
-								totalCount += cnt;
-							sprintf(str, "%02d:%02d:%02d - Intruder %s detected on %s", currTime->tm_hour,
-								currTime->tm_min, currTime->tm_sec, labelNames[i].c_str(),
-								prevVideoCap->camName.c_str());
-							logList.emplace_back(str);
-							sprintf(str, "%s\n", str);
-							cout << str;
-							logFile << str;
-							if (logList.size() > rollingLogSize)
-							{
-								logList.pop_front();
-							}
-							event evt;
-							sprintf(evt.time, "%02d:%02d:%02d", currTime->tm_hour, currTime->tm_min,
-								currTime->tm_sec);
-							evt.intruder = labelNames[i];
-							evt.frame = prevVideoCap->frameCount;
-							evt.count = totalCount;
-							prevVideoCap->events.push_back(evt);
-
-						}
-						// Saving image when detection occurs
-						sprintf(str, "./caps/%d%d_%s.jpg", currTime->tm_hour, currTime->tm_min, labelNames[i].c_str());
-						imwrite(str, prev_frame);
-					}
-
-					prevVideoCap->lastCorrectCount[i] = prevVideoCap->currentCount[i];
-				}
-				++prevVideoCap->frameCount;
-
-				//----------------------------------------
-				// Display the video result and log window
-				//----------------------------------------
-				if(isUI  && !(loopVideos))
-					prevVideoCap->vw.write(prev_frame);
-				int i = 0;
-				logs = Mat(logWinHeight, logWinWidth, CV_8UC1, Scalar(0));
-				for (list<string>::iterator it = logList.begin(); it != logList.end(); ++it)
-				{
-					putText(logs, *it, Point(10, 15 + 20 * i), cv::FONT_HERSHEY_SIMPLEX, 0.5, Scalar(255, 255, 255), 1);
-					++i;
-				}
-				std::chrono::high_resolution_clock::time_point end_time = std::chrono::high_resolution_clock::now();
-				std::chrono::duration<float> frame_time = std::chrono::duration_cast<std::chrono::duration<float>>(end_time - start_time);
-				char vid_fps[20];
-				sprintf(vid_fps, "FPS: %.2f", 1 / frame_time.count());
-				cv::putText(prev_frame, string(vid_fps), cv::Point(10, prevVideoCap->inputHeight - 10), cv::FONT_HERSHEY_SIMPLEX,
-							0.5, cv::Scalar(255, 255, 255), 1, 8, false);
-				char infTm[100];
-				if (!isAsyncMode)
-				{
-				// In the true async mode, there is no way to measure detection time directly
-				sprintf(infTm, "Infer time: %.3f", infer_time.count());
-				}
-				else
-				{
-				sprintf(infTm, "Infer time: N/A for Async mode");
-				}
-				cv::putText(prev_frame, string(infTm), cv::Point(10, prevVideoCap->inputHeight - 30), cv::FONT_HERSHEY_SIMPLEX,
-						0.5, cv::Scalar(255, 255, 255), 1, 8, false);
-				cv::imshow(prevVideoCap->camName, prev_frame);
-				cv::imshow("Intruder Log", logs);
-				start_time = std::chrono::high_resolution_clock::now();
-
-				if (loopVideos && !vidCapObj.isCam)
-				{
-					int vfps = (int)round(vidCapObj.vc.get(CAP_PROP_FPS));
-					if (vidCapObj.loopFrames > vidCapObj.vc.get(cv::CAP_PROP_FRAME_COUNT) - round(vfps / minFPS))
-					{
-						vidCapObj.loopFrames = 0;
-						vidCapObj.vc.set(cv::CAP_PROP_POS_FRAMES, 0);
-					}
-				}
-			}
-			++index;
-			if (isAsyncMode) {
-				currInfReq.swap(nextInfReq);
-				prev_frame = vidCapObj.frame.clone();
-				prevVideoCap = &vidCapObj;
-			}
-		}
-
-		// Press Esc to exit the application 
-		if (waitKey(1) == 27)
-		{
-			break;
-		}
-
-		// Check if all the videos have ended
-		if (find(noMoreData.begin(), noMoreData.end(), false) == noMoreData.end())
-			break;
-
-	}
 
-	// Save the JSON output
-	saveJSON(vidCaps[0].events, vidCaps[0]);
-	destroyAllWindows();
-	return 0;
+	PipelineOptions options;
+	options.logPath = "intruders.log";
+	options.snapshotDir = "./caps";
+	options.uiDataDir = "../UI/resources/video_data";
+	options.uiVideoDir = "../UI/resources/videos";
+	options.archivePath = archivePath;
+	if (!replayPath.empty())
+		return replayRecording(replayPath, options);
+
+	options.modelPath = conf_modelPath;
+	options.labelsPath = conf_labelsFilePath;
+	options.device = conf_targetDevice;
+	options.syntheticScript = conf_syntheticScript;
+	options.async = isAsyncMode;
+	options.loop = loopVideos;
+	options.ui = isUI;
+	options.mosaicRate = mosaicRate;
+	options.metricsPort = metricsPort;
+	options.livePort = livePort;
+	options.recordPath = recordPath;
+
+	// SIGUSR1 writes the trace without stopping
+	if (tracer().enabled)
+		signal(SIGUSR1, traceSignalHandler);
+
+	Pipeline pipeline(options);
+	int err = pipeline.open();
+	if (!err)
+		err = pipeline.run();
+	pipeline.close();
+	return err;
 }
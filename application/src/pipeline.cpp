@@ -0,0 +1,1255 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <ctime>
+#include <chrono>
+
+#include "opencv2/opencv.hpp"
+#include "opencv2/highgui/highgui.hpp"
+
+#include <samples/slog.hpp>
+#include <pipeline.hpp>
+#include <trace.hpp>
+#include <openvino_detector.hpp>
+#include <synthetic_detector.hpp>
+#include <counting.hpp>
+
+using namespace cv;
+using namespace InferenceEngine;
+
+static const int logWinHeight = 432;
+static const int logWinWidth = 410;
+
+
+std::vector<bool> getUsedLabels(const std::string &labelsPath, std::vector<string> *reqLabels,
+				std::vector<int> *labelPos, std::vector<string> *labelNames)
+{
+	std::vector<bool> usedLabels;
+
+	std::ifstream labelsFile(labelsPath);
+
+	if (!labelsFile.is_open())
+	{
+		std::cout << "Could not open labels file" << std::endl;
+		return usedLabels;
+	}
+
+	std::string label;
+	int i = 0;
+	while (getline(labelsFile, label))
+	{
+		if (std::find((*reqLabels).begin(), (*reqLabels).end(), label) != (*reqLabels).end())
+		{
+			usedLabels.push_back(true);
+			(*labelPos).push_back(i);
+			(*labelNames).push_back(label);
+			++i;
+		}
+		else
+		{
+			usedLabels.push_back(false);
+			(*labelPos).push_back(0);
+		}
+	}
+
+	labelsFile.close();
+
+	return usedLabels;
+}
+
+
+// Copy the per-stream settings of config.json into a stream
+static void applySpec(VideoCap &vcap, const StreamSpec &spec)
+{
+	vcap.specKey = spec.key();
+	vcap.netHeight = spec.netHeight;
+	vcap.netWidth = spec.netWidth;
+	vcap.netPrecision = spec.netPrecision;
+	vcap.tiling.enabled = spec.tiled;
+	vcap.tiling.overlap = spec.overlap;
+	vcap.tiling.skipStatic = spec.skipStatic;
+}
+
+
+// Streams are named after their id, which stays unique across reloads
+static string streamName(int streamId)
+{
+	return "Cam " + to_string(streamId + 1);
+}
+
+
+// Annotated video of a stream, named as the browser UI expects
+static string uiVideoPath(const string &dir, int streamId)
+{
+	return dir + "/video" + to_string(streamId + 1) + ".mp4";
+}
+
+
+// A single digit in place of a video path selects a camera
+static bool isCameraIndex(const string &path)
+{
+	return path.size() == 1 && path[0] >= '0' && path[0] <= '9';
+}
+
+
+// Open a video file or camera, printing a message if it cannot be opened
+static bool openCapture(const string &video, cv::VideoCapture *vc)
+{
+	if (isCameraIndex(video))
+		vc->open(std::stoi(video));
+	else
+		vc->open(video);
+	if (!vc->isOpened())
+	{
+		std::cout << "Couldn't open video " << video << std::endl;
+		return false;
+	}
+	return true;
+}
+
+
+// Get the minimum fps of the videos
+static int get_minFPS(std::list<VideoCap> &vidCaps)
+{
+	int minFPS = 240;
+
+	for (auto &&i : vidCaps)
+	{
+		minFPS = std::min(minFPS, (int)round(i.vc.get(CAP_PROP_FPS)));
+	}
+
+	return minFPS;
+}
+
+
+// Arranges the windows so that they are not overlapping
+static void arrangeWindows(std::list<VideoCap> *vidCaps, size_t width, size_t height)
+{
+	int spacer = 470;
+	int rowSpacer = 250;
+	int cols = 0;
+	int rows = 0;
+
+	namedWindow("Intruder Log", WINDOW_AUTOSIZE);
+	moveWindow("Intruder Log", 0, 0);
+
+	for (auto &vidCapObj : *vidCaps)
+	{
+		namedWindow(vidCapObj.camName, WINDOW_NORMAL);
+		resizeWindow(vidCapObj.camName, displayWindowWidth, displayWindowHeight);
+
+		if (cols == conf_windowColumns)
+		{
+			cols = 1;
+			++rows;
+			moveWindow(vidCapObj.camName, spacer * cols, rowSpacer * rows);
+		}
+		else
+		{
+			++cols;
+			moveWindow(vidCapObj.camName, spacer * cols, rowSpacer * rows);
+		}
+	}
+}
+
+
+void writeEventJSON(const deque<event> &events, double fps, std::ostream &evtJson, std::ostream &dataJson)
+{
+	int total = 0;
+
+	evtJson << "{\n\t\"video1\": {\n";
+	dataJson << "{\n\t\"video1\": {\n";
+	if (!events.empty())
+	{
+		int evts = static_cast<int>(events.size());
+		int i = 0;
+		for (; i < evts - 1; ++i)
+		{
+			evtJson << "\t\t\"" << i << "\":{\n";
+			evtJson << "\t\t\t\"time\":\"" << events[i].time << "\",\n";
+			evtJson << "\t\t\t\"content\":\"" << events[i].intruder << "\",\n";
+			evtJson << "\t\t\t\"videoTime\":\"" << (float)events[i].frame / (int)fps << "\"\n";
+			evtJson << "\t\t},\n";
+
+			dataJson << "\t\t\"" << (float)events[i].frame / (int)fps << "\": \"" << events[i].count << "\",\n";
+		}
+
+		evtJson << "\t\t\"" << i << "\":{\n";
+		evtJson << "\t\t\t\"time\":\"" << events[i].time << "\",\n";
+		evtJson << "\t\t\t\"content\":\"" << events[i].intruder << "\",\n";
+		evtJson << "\t\t\t\"videoTime\":\"" << (float)events[i].frame / (int)fps << "\"\n";
+		evtJson << "\t\t}\n";
+
+		dataJson << "\t\t\"" << (float)events[i].frame / (int)fps << "\": \"" << events[i].count << "\"\n";
+		total = events[i].count;
+	}
+	evtJson << "\t}\n";
+	evtJson << "}";
+
+	dataJson << "\t},\n";
+	dataJson << "\t\"totals\":{\n";
+	dataJson << "\t\t\"video1\": \"" << total << "\"\n";
+	dataJson << "\t}\n";
+	dataJson << "}";
+}
+
+
+void saveJSON(const string &dir, const deque<event> &events, const VideoCap &vcap)
+{
+
+	ofstream evtJson(dir + "/events.json");
+	if (!evtJson.is_open())
+	{
+		cout << "Could not create JSON file" << endl;
+		return;
+	}
+
+	ofstream dataJson(dir + "/data.json");
+	if (!dataJson.is_open())
+	{
+		cout << "Could not create JSON file" << endl;
+		return;
+	}
+
+	writeEventJSON(events, vcap.fps, evtJson, dataJson);
+}
+
+
+int replayRecording(const string &path, const PipelineOptions &options)
+{
+	RecordingReader reader;
+	if (!reader.open(path))
+	{
+		cout << "Could not read recording " << path << endl;
+		return 7;
+	}
+
+	vector<bool> usedLabels;
+	for (int pos : reader.labelPos)
+		usedLabels.push_back(pos >= 0);
+	const vector<string> &labelNames = reader.usedLabels;
+	// Counted with the settings in effect when recording, the defaults before version 2
+	double threshold = conf_thresholdValue;
+	int candidateConfidence = conf_candidateConfidence;
+	if (reader.header.version >= 2)
+	{
+		threshold = reader.header.threshold;
+		candidateConfidence = reader.header.candidateConfidence;
+	}
+
+	vector<VideoCap> streams;
+	for (size_t i = 0; i < reader.streams.size(); ++i)
+	{
+		const RecordingStream &rs = reader.streams[i];
+		streams.push_back(VideoCap(rs.width, rs.height, rs.fps, string(rs.name, strnlen(rs.name, recording_nameSize))));
+		streams.back().init(labelNames.size());
+		streams.back().streamId = i;
+	}
+	if (streams.empty())
+	{
+		cout << "Recording " << path << " has no streams" << endl;
+		return 7;
+	}
+
+	ofstream logFile;
+	if (!options.logPath.empty())
+	{
+		logFile.open(options.logPath);
+		if (!logFile.is_open())
+		{
+			cout << "Could not create log file\n";
+			return 3;
+		}
+	}
+
+	EventArchive archive;
+	if (!options.archivePath.empty() && !archive.open(options.archivePath))
+	{
+		cout << "Could not open event archive " << options.archivePath << endl;
+		return 8;
+	}
+
+	RecordingFrame rec;
+	const float *rows;
+	vector<Detection> detections;
+	uint64_t frames = 0, events = 0;
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	while (reader.next(&rec, &rows))
+	{
+		VideoCap *vcap = &streams[rec.stream];
+		parseSSD(rows, rec.rows, &detections);
+		vcap->frameCount = rec.frame;
+		countDetections(vcap, detections, usedLabels, reader.labelPos, threshold,
+			candidateConfidence, [&](int i, int detObj)
+		{
+			time_t t = rec.timeUs / 1000000;
+			tm *when = localtime(&t);
+			for (int j = 0; j < detObj; ++j)
+			{
+				logFile << recordEvent(vcap, labelNames[i], *when) << "\n";
+				const event &evt = vcap->events.back();
+				archive.append(rec.timeUs, vcap->streamId, vcap->camName, labelNames[i], evt.frame, evt.count);
+				++events;
+			}
+		});
+		++frames;
+	}
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+	cout << "Replayed " << frames << " frames and " << events << " events in " << elapsed.count() << " s ("
+		<< frames / elapsed.count() << " frames/s)" << endl;
+
+	if (!options.uiDataDir.empty())
+		saveJSON(options.uiDataDir, streams[0].events, streams[0]);
+	return 0;
+}
+
+
+Pipeline::Pipeline(const PipelineOptions &options)
+	: options(options)
+	, rollingLogSize((logWinHeight - 15) / 20)
+{
+	// The mosaic is a display too
+	if (!this->options.display)
+		this->options.mosaicRate = 0;
+}
+
+
+Pipeline::~Pipeline()
+{
+	close();
+}
+
+
+// Cut the frames of a tiled stream into tiles of its network input size
+void Pipeline::initTiling(VideoCap &vcap)
+{
+	if (!vcap.tiling.enabled)
+		return;
+	cv::Size tile(vcap.netWidth ? vcap.netWidth : modelWidth, vcap.netHeight ? vcap.netHeight : modelHeight);
+	cv::Size frameSize(vcap.vc.get(cv::CAP_PROP_FRAME_WIDTH), vcap.vc.get(cv::CAP_PROP_FRAME_HEIGHT));
+	vcap.tiling.init(frameSize, tile);
+	cout << vcap.camName << ": " << vcap.tiling.tiles.size() << " tiles of " << tile.width << "x" << tile.height << endl;
+}
+
+
+// Work out the batch a stream is inferred with and the key of the network it
+// needs. Streams with the same key share one compiled network.
+std::string Pipeline::networkKey(const VideoCap &vcap, size_t *batch)
+{
+	// Tiled streams infer every tile of a frame in one batch
+	*batch = vcap.tiling.enabled ? vcap.tiling.tiles.size() : conf_batchSize;
+
+	if (!options.syntheticScript.empty())
+		return "synthetic";
+	return to_string(vcap.netHeight) + "x" + to_string(vcap.netWidth) + " " + vcap.netPrecision + " b" + to_string(*batch);
+}
+
+
+// Compile the network for a stream, as keyed by networkKey()
+Detector *Pipeline::createDetector(const VideoCap &vcap, size_t batch)
+{
+	if (!options.syntheticScript.empty())
+	{
+		slog::info << "Using synthetic detector " << options.syntheticScript << slog::endl;
+		return new SyntheticDetector(options.syntheticScript);
+	}
+	return new OpenVinoDetector(ie, options.modelPath, options.device, batch,
+		vcap.netHeight, vcap.netWidth, vcap.netPrecision);
+}
+
+
+// Open a stream, and compile a network for it if none of the running ones
+// fit and no other stream is compiling one already. Runs on a background
+// thread so that slow cameras and network loading do not stall the other
+// streams.
+Pipeline::OpenedStream Pipeline::openStream(StreamSpec spec, int streamId)
+{
+	OpenedStream opened;
+	bool isCam = isCameraIndex(spec.video);
+	cv::VideoCapture vc;
+	if (!openCapture(spec.video, &vc))
+		return opened;
+
+	opened.vcap.push_back(VideoCap(vc, isCam ? "stream" : spec.video, isCam, streamName(streamId)));
+	VideoCap &vcap = opened.vcap.back();
+	applySpec(vcap, spec);
+	vcap.streamId = streamId;
+	vcap.inputWidth = vc.get(cv::CAP_PROP_FRAME_WIDTH);
+	vcap.inputHeight = vc.get(cv::CAP_PROP_FRAME_HEIGHT);
+
+	initTiling(vcap);
+	size_t batch;
+	opened.key = networkKey(vcap, &batch);
+	std::promise<std::shared_ptr<Detector>> compiled;
+	bool compile = false;
+	{
+		std::lock_guard<std::mutex> lock(networksMutex);
+		auto it = networks.find(opened.key);
+		if (it == networks.end())
+		{
+			it = networks.insert(std::make_pair(opened.key, compiled.get_future().share())).first;
+			compile = true;
+		}
+		opened.network = it->second;
+	}
+	if (compile)
+	{
+		try
+		{
+			compiled.set_value(std::shared_ptr<Detector>(createDetector(vcap, batch)));
+		}
+		catch (const std::exception &e)
+		{
+			// Let a later reload try again
+			{
+				std::lock_guard<std::mutex> lock(networksMutex);
+				networks.erase(opened.key);
+			}
+			compiled.set_exception(std::current_exception());
+		}
+	}
+
+	try
+	{
+		opened.network.get();
+	}
+	catch (const std::exception &e)
+	{
+		std::cout << "Could not load the network for " << spec.video << ": " << e.what() << std::endl;
+		opened.vcap.clear();
+	}
+	return opened;
+}
+
+
+int Pipeline::open()
+{
+	std::ifstream confFile(options.configPath);
+	if (!confFile.is_open())
+	{
+		cout << "Could not open config file" << endl;
+		return 2;
+	}
+
+	// Create VideoCap objects for all the videos and camera
+	AppConfig cfg;
+	std::string error;
+	if (!parseConfig(confFile, &cfg, &error))
+	{
+		cout << "Could not parse config file: " << error << endl;
+		return 2;
+	}
+	for (const StreamSpec &spec : cfg.streams)
+	{
+		cv::VideoCapture vc;
+		if (!openCapture(spec.video, &vc))
+			return 10;
+		bool isCam = isCameraIndex(spec.video);
+		vidCaps.push_back(VideoCap(vc, isCam ? "stream" : spec.video, isCam, streamName(nextStreamId)));
+		applySpec(vidCaps.back(), spec);
+		vidCaps.back().streamId = nextStreamId++;
+	}
+	threshold = cfg.threshold;
+	candidateConfidence = cfg.candidateConfidence;
+
+	// Read class names
+	usedLabels = getUsedLabels(options.labelsPath, &cfg.labels, &labelPos, &labelNames);
+	if (usedLabels.empty())
+	{
+		std::cout<< "Error: No labels currently in use. Please edit conf.txt file"<< std::endl;
+		return 1;
+	}
+	for (auto &vidCapObj : vidCaps)
+		vidCapObj.init(labelNames.size());
+
+	// Inference engine initialization. Streams asking for the same input
+	// shape and precision share one compiled network; all networks share
+	// one Core.
+	if (options.syntheticScript.empty())
+	{
+		OpenVinoDetector::modelInputSize(ie, options.modelPath, &modelHeight, &modelWidth);
+	}
+	else
+	{
+		// All streams share the scripted detector, whose input stands in for the model's
+		std::shared_ptr<Detector> &detector = detectors["synthetic"];
+		slog::info << "Using synthetic detector " << options.syntheticScript << slog::endl;
+		detector.reset(new SyntheticDetector(options.syntheticScript));
+		modelHeight = detector->inputHeight();
+		modelWidth = detector->inputWidth();
+	}
+	for (auto &vidCapObj : vidCaps)
+	{
+		initTiling(vidCapObj);
+		size_t batch;
+		std::shared_ptr<Detector> &detector = detectors[networkKey(vidCapObj, &batch)];
+		if (!detector)
+		{
+			detector.reset(createDetector(vidCapObj, batch));
+			detector->shapeId = detectors.size() - 1;
+		}
+		if (detector->batchSize() < batch)
+		{
+			cout << detector->name << " cannot infer the " << batch << " tiles of " << vidCapObj.camName
+				<< " in one batch" << endl;
+			return 9;
+		}
+		vidCapObj.detector = detector.get();
+	}
+	// Streams added later reuse these networks
+	for (auto &d : detectors)
+	{
+		std::promise<std::shared_ptr<Detector>> compiled;
+		compiled.set_value(d.second);
+		networks[d.first] = compiled.get_future().share();
+	}
+
+	// Initializing VideoWriter for each source
+	for (auto &vidCapObj : vidCaps)
+	{
+		vidCapObj.inputWidth = vidCapObj.vc.get(cv::CAP_PROP_FRAME_WIDTH);
+		vidCapObj.inputHeight = vidCapObj.vc.get(cv::CAP_PROP_FRAME_HEIGHT);
+		if (options.ui && !(options.loop) && !options.uiVideoDir.empty())
+		{
+			vidCapObj.videoName = uiVideoPath(options.uiVideoDir, vidCapObj.streamId);
+			if (!vidCapObj.initVW(vidCapObj.inputHeight, vidCapObj.inputWidth))
+			{
+				cout << "Could not open " << vidCapObj.videoName << " for writing\n";
+				return 4;
+			}
+		}
+	}
+
+	if (options.mosaicRate > 0)
+	{
+		vector<string> camNames;
+		for (auto &vidCapObj : vidCaps)
+			camNames.push_back(vidCapObj.camName);
+		mosaic.start(camNames, options.mosaicRate);
+	}
+	else if (options.display)
+	{
+		arrangeWindows(&vidCaps, displayWindowWidth, displayWindowHeight);
+	}
+
+	if (!options.logPath.empty())
+	{
+		logFile.open(options.logPath);
+		if (!logFile.is_open())
+		{
+			cout << "Could not create log file\n";
+			return 3;
+		}
+	}
+
+	// Binary event archive, queried with intruder-archive
+	if (!options.archivePath.empty())
+	{
+		if (!archive.open(options.archivePath))
+		{
+			cout << "Could not open event archive " << options.archivePath << endl;
+			return 8;
+		}
+		cout << "Archiving events to " << options.archivePath << endl;
+	}
+
+	// Raw detector output recording
+	if (!options.recordPath.empty())
+	{
+		vector<RecordingStream> recStreams;
+		for (auto &vidCapObj : vidCaps)
+		{
+			RecordingStream rs;
+			memset(&rs, 0, sizeof(rs));
+			strncpy(rs.name, vidCapObj.camName.c_str(), recording_nameSize - 1);
+			rs.width = vidCapObj.inputWidth;
+			rs.height = vidCapObj.inputHeight;
+			rs.fps = vidCapObj.fps;
+			recStreams.push_back(rs);
+		}
+		vector<int> recLabelPos;
+		for (size_t i = 0; i < usedLabels.size(); ++i)
+			recLabelPos.push_back(usedLabels[i] ? labelPos[i] : -1);
+		if (!recorder.open(options.recordPath, recStreams, recLabelPos, labelNames, threshold, candidateConfidence))
+		{
+			cout << "Could not create recording " << options.recordPath << endl;
+			return 7;
+		}
+	}
+
+	// Metrics endpoint, off unless a port was given
+	if (options.metricsPort > 0)
+	{
+		metrics().enabled = true;
+		for (auto &vidCapObj : vidCaps)
+			vidCapObj.metricsSlot = metrics().addStream(vidCapObj.camName);
+		metrics().setLabelNames(labelNames);
+		for (auto &d : detectors)
+			metrics().setShapeName(d.second->shapeId, d.second->name);
+		if (!metricsServer.start(options.metricsPort))
+		{
+			cout << "Could not start metrics listener on port " << options.metricsPort << endl;
+			return 5;
+		}
+		cout << "Serving metrics on http://127.0.0.1:" << options.metricsPort << "/metrics" << endl;
+	}
+
+	// Frame tracing, off unless a trace file was given
+	if (tracer().enabled)
+	{
+		tracer().nameThread("main");
+		for (auto &vidCapObj : vidCaps)
+			tracer().setStreamName(vidCapObj.streamId, vidCapObj.camName);
+		cout << "Tracing frames to " << tracer().outputPath << endl;
+	}
+
+	// Live event stream for the browser UI
+	if (options.livePort > 0)
+	{
+		if (!liveFeed.start(options.livePort))
+		{
+			cout << "Could not start live event stream on port " << options.livePort << endl;
+			return 6;
+		}
+		cout << "Streaming events on http://127.0.0.1:" << options.livePort << "/events" << endl;
+	}
+
+	// Changes to config.json are applied without a restart
+	if (options.watchConfig && !configWatcher.start(options.configPath))
+		cout << "Could not watch " << options.configPath << " for changes" << endl;
+
+	minFPS = get_minFPS(vidCaps);
+	if(options.async)
+		std::cout<<"Application runnning in Async mode"<<std::endl;
+	else
+		std::cout<<"Application runnning in sync mode"<<std::endl;
+
+	start_time = std::chrono::high_resolution_clock::now();
+	run_start_time = std::chrono::high_resolution_clock::now();
+	started = true;
+	return 0;
+}
+
+
+//---------------------------
+// Apply config.json changes between frames, so that every frame is
+// counted with one set of labels and thresholds
+//---------------------------
+void Pipeline::applyConfigChanges()
+{
+	AppConfig newConfig;
+	if (configWatcher.poll(&newConfig))
+	{
+		vector<int> newLabelPos;
+		vector<string> newLabelNames;
+		vector<bool> newUsedLabels = getUsedLabels(options.labelsPath, &newConfig.labels, &newLabelPos, &newLabelNames);
+		bool labelsChanged = !newUsedLabels.empty() && newLabelNames != labelNames;
+
+		// A recording holds one set of labels and thresholds, so it ends here
+		if (recorder.isOpen() && (labelsChanged || newConfig.threshold != threshold ||
+			newConfig.candidateConfidence != candidateConfidence))
+		{
+			recorder.close();
+			cout << "Recording " << options.recordPath << " ended: labels or thresholds changed" << endl;
+		}
+		threshold = newConfig.threshold;
+		candidateConfidence = newConfig.candidateConfidence;
+
+		if (labelsChanged)
+		{
+			for (auto &vidCapObj : vidCaps)
+				vidCapObj.remapLabels(labelNames, newLabelNames);
+			usedLabels.swap(newUsedLabels);
+			labelPos.swap(newLabelPos);
+			labelNames.swap(newLabelNames);
+			metrics().setLabelNames(labelNames);
+		}
+
+		// Streams are matched by video and group settings; everything
+		// left over on either side is removed or added
+		vector<bool> claimed(newConfig.streams.size(), false);
+		auto claim = [&](const std::string &key) -> bool
+		{
+			for (size_t i = 0; i < newConfig.streams.size(); ++i)
+			{
+				if (!claimed[i] && newConfig.streams[i].key() == key)
+				{
+					claimed[i] = true;
+					return true;
+				}
+			}
+			return false;
+		};
+		for (auto &vidCapObj : vidCaps)
+		{
+			if (!vidCapObj.draining && !claim(vidCapObj.specKey))
+				vidCapObj.draining = true;
+		}
+		for (auto &pending : pendingStreams)
+		{
+			if (!pending.cancelled && !claim(pending.specKey))
+				pending.cancelled = true;
+		}
+
+		for (size_t i = 0; i < newConfig.streams.size(); ++i)
+		{
+			if (claimed[i])
+				continue;
+			const StreamSpec &spec = newConfig.streams[i];
+			cout << "Opening " << spec.video << endl;
+			PendingStream pending;
+			pending.specKey = spec.key();
+			pending.cancelled = false;
+			pending.result = std::async(std::launch::async, &Pipeline::openStream, this, spec, nextStreamId++);
+			pendingStreams.push_back(std::move(pending));
+		}
+		metrics().queueDepth("streams_opening", pendingStreams.size());
+		cout << "Reloaded " << options.configPath << ": " << newConfig.streams.size() << " streams, "
+			<< labelNames.size() << " labels, threshold " << threshold << endl;
+	}
+
+	// Close removed streams. A frame still in flight is collected first
+	// so that the network's queue stays in step with prevVideoCap.
+	bool streamsChanged = false;
+	for (auto it = vidCaps.begin(); it != vidCaps.end();)
+	{
+		if (!it->draining)
+		{
+			++it;
+			continue;
+		}
+		if (&*it == prevVideoCap)
+		{
+			if (prevDetector && prevDetector->wait(&detResult) != DETECT_NOT_STARTED)
+				metrics().gaugeAdd(GAUGE_INFLIGHT, -1);
+			prevVideoCap = nullptr;
+			prevDetector = nullptr;
+		}
+		if (options.mosaicRate > 0)
+			mosaic.removeStream(it->streamId);
+		else if (options.display)
+			destroyWindow(it->camName);
+		metrics().removeStream(it->metricsSlot);
+		cout << "Removed " << it->camName << " (" << it->inputVideo << ")" << endl;
+		it = vidCaps.erase(it);
+		minFPS = vidCaps.empty() ? minFPS : get_minFPS(vidCaps);
+		streamsChanged = true;
+	}
+
+	// Start streams whose background open has finished
+	for (auto it = pendingStreams.begin(); it != pendingStreams.end();)
+	{
+		if (it->result.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			++it;
+			continue;
+		}
+		OpenedStream opened = it->result.get();
+		bool cancelled = it->cancelled;
+		it = pendingStreams.erase(it);
+		metrics().queueDepth("streams_opening", pendingStreams.size());
+		streamsChanged = true;
+		if (opened.vcap.empty() || cancelled)
+			continue;
+
+		std::shared_ptr<Detector> &detector = detectors[opened.key];
+		if (!detector)
+		{
+			// Take the lowest metrics slot no other network uses
+			int shapeId = 0;
+			while (std::any_of(detectors.begin(), detectors.end(),
+				[shapeId](const std::pair<const std::string, std::shared_ptr<Detector>> &d)
+				{ return d.second && d.second->shapeId == shapeId; }))
+				++shapeId;
+			detector = opened.network.get();
+			detector->shapeId = shapeId;
+			metrics().setShapeName(detector->shapeId, detector->name);
+		}
+		VideoCap &vcap = opened.vcap.front();
+		size_t batch;
+		networkKey(vcap, &batch);
+		if (detector->batchSize() < batch)
+		{
+			cout << detector->name << " cannot infer the " << batch << " tiles of " << vcap.camName
+				<< " in one batch" << endl;
+			continue;
+		}
+		vcap.detector = detector.get();
+		vcap.init(labelNames.size());
+		if (options.ui && !(options.loop) && !options.uiVideoDir.empty())
+		{
+			vcap.videoName = uiVideoPath(options.uiVideoDir, vcap.streamId);
+			if (!vcap.initVW(vcap.inputHeight, vcap.inputWidth))
+				cout << "Could not open " << vcap.videoName << " for writing\n";
+		}
+		if (metrics().enabled)
+			vcap.metricsSlot = metrics().addStream(vcap.camName);
+		tracer().setStreamName(vcap.streamId, vcap.camName);
+		if (options.mosaicRate > 0)
+			mosaic.addStream(vcap.streamId, vcap.camName);
+		cout << "Added " << vcap.camName << " (" << vcap.inputVideo << ")" << endl;
+		vidCaps.splice(vidCaps.end(), opened.vcap);
+		minFPS = get_minFPS(vidCaps);
+	}
+
+	if (streamsChanged)
+		releaseNetworks();
+}
+
+
+// Drop the networks no stream uses any more. Waits until no stream is being
+// opened, since an opening stream may be about to use one of them.
+void Pipeline::releaseNetworks()
+{
+	if (!pendingStreams.empty())
+		return;
+	std::lock_guard<std::mutex> lock(networksMutex);
+	for (auto it = networks.begin(); it != networks.end();)
+	{
+		const std::shared_ptr<Detector> &detector = it->second.get();
+		bool used = false;
+		for (auto &vidCapObj : vidCaps)
+			used = used || vidCapObj.detector == detector.get();
+		if (used)
+		{
+			++it;
+			continue;
+		}
+		cout << "Released network " << detector->name << endl;
+		detectors.erase(it->first);
+		it = networks.erase(it);
+	}
+}
+
+
+//---------------------------
+// Get a new frame
+//---------------------------
+bool Pipeline::capture(VideoCap &vcap)
+{
+	MetricTime decode_start_time = std::chrono::high_resolution_clock::now();
+	int vfps = (int)round(vcap.vc.get(CAP_PROP_FPS));
+	int framesRead = 0;
+	Mat frame;
+	for (int i = 0; i < round(vfps / minFPS); ++i)
+	{
+		vcap.vc.read(frame);
+		vcap.loopFrames++;
+		vcap.frame = frame;
+		++framesRead;
+	}
+	if (!frame.data)
+	{
+		vcap.ended = true;
+	}
+	else
+	{
+		vcap.frameId = tracer().newFrame();
+		metrics().observeSince(STAGE_DECODE, decode_start_time);
+		tracer().record("decode", decode_start_time, vcap.frameId, vcap.streamId);
+		metrics().frameDecoded(vcap.metricsSlot, framesRead);
+		if (framesRead > 1)
+			metrics().frameSkipped(vcap.metricsSlot, framesRead - 1);
+	}
+	if (vcap.ended)
+	{
+		Mat messageWindow = Mat(displayWindowHeight, displayWindowWidth, CV_8UC1, Scalar(0));
+		std::string message = "Video stream from " + vcap.camName + " has ended!";
+		cv::putText(messageWindow, message, Point((250), displayWindowHeight/2),
+				cv::FONT_HERSHEY_COMPLEX, 0.5, (255, 255, 255), 1);
+		if (options.mosaicRate > 0)
+			mosaic.submit(vcap.streamId, messageWindow);
+		else if (options.display)
+			imshow(vcap.camName, messageWindow);
+		return false;
+	}
+	return true;
+}
+
+
+//---------------------------------------------
+// Resize to expected size (in model .xml file)
+//---------------------------------------------
+bool Pipeline::preprocess(VideoCap &vcap, std::vector<cv::Mat> *images)
+{
+	MetricTime preprocess_start_time = std::chrono::high_resolution_clock::now();
+	Detector *detector = vcap.detector;
+	images->clear();
+	if (vcap.tiling.enabled)
+	{
+		// Tiles are cut at native scale, one batch entry each
+		for (int t : vcap.tiling.select(vcap.frame))
+			images->push_back(vcap.frame(vcap.tiling.tiles[t]));
+	}
+	else
+	{
+		// Input frame is resized to infer resolution
+		Mat resized;
+		resize(vcap.frame, resized, Size(detector->inputWidth(), detector->inputHeight()));
+		images->push_back(resized);
+
+		size_t framesize = resized.rows * resized.step1();
+		size_t input_size = detector->inputWidth() * detector->inputHeight() * detector->inputChannels();
+		if (framesize != input_size)
+		{
+			std::cout << "input pixels mismatch, expecting "
+						<< input_size << " bytes, got: " << framesize
+						<< endl;
+			return false;
+		}
+	}
+	metrics().observeSince(STAGE_PREPROCESS, preprocess_start_time);
+	tracer().record("preprocess", preprocess_start_time, vcap.frameId, vcap.streamId);
+	return true;
+}
+
+
+//---------------------------
+// INFER STAGE
+//---------------------------
+DetectStatus Pipeline::infer(VideoCap &vcap, const std::vector<cv::Mat> &images)
+{
+	typedef std::chrono::duration<double,std::ratio<1, 1000>> ms;
+	Detector *detector = vcap.detector;
+	if (!options.async)
+	{
+		prevVideoCap = &vcap;
+		prevFrameId = vcap.frameId;
+		prev_frame = vcap.frame;
+		prevDetector = detector;
+	}
+
+	std::chrono::high_resolution_clock::time_point infer_start_time = std::chrono::high_resolution_clock::now();
+	if (vcap.tiling.enabled)
+		detector->submitBatch(images);
+	else
+		detector->submit(images[0]);
+	metrics().gaugeAdd(GAUGE_INFLIGHT, 1);
+	tracer().record("submit", infer_start_time, vcap.frameId, vcap.streamId);
+	std::chrono::high_resolution_clock::time_point infer_stop_time = std::chrono::high_resolution_clock::now();
+	inferMs = std::chrono::duration_cast<ms>(infer_stop_time - infer_start_time).count();
+
+	// In async mode the frame submitted just before this one is collected
+	DetectStatus inferStatus = prevDetector ? prevDetector->wait(&detResult) : DETECT_NOT_STARTED;
+	doneVideoCap = prevVideoCap;
+	doneDetector = prevDetector;
+	doneFrameId = prevFrameId;
+	done_frame = prev_frame;
+	if (inferStatus != DETECT_NOT_STARTED)
+		metrics().gaugeAdd(GAUGE_INFLIGHT, -1);
+	if (inferStatus == DETECT_FAILED)
+	{
+		metrics().frameDropped(doneVideoCap->metricsSlot);
+		if (doneVideoCap->tiling.enabled)
+			doneVideoCap->tiling.drop();
+	}
+	if (inferStatus == DETECT_OK)
+	{
+		metrics().observeSince(STAGE_INFER, infer_start_time);
+		tracer().record("wait", infer_stop_time, doneFrameId, doneVideoCap->streamId);
+		metrics().frameInferred(doneVideoCap->metricsSlot);
+	}
+
+	if (options.async)
+	{
+		prev_frame = vcap.frame.clone();
+		prevVideoCap = &vcap;
+		prevFrameId = vcap.frameId;
+		prevDetector = detector;
+	}
+	else
+	{
+		// Nothing is left in flight
+		prevVideoCap = nullptr;
+		prevDetector = nullptr;
+	}
+	return inferStatus;
+}
+
+
+//---------------------------
+// POSTPROCESS STAGE:
+// Count the detections
+//---------------------------
+void Pipeline::postprocess(DetectStatus status)
+{
+	// No frame was collected, or its inference failed
+	if (status != DETECT_OK || !doneVideoCap || !doneDetector)
+		return;
+
+	MetricTime postprocess_start_time = std::chrono::high_resolution_clock::now();
+	VideoCap *vcap = doneVideoCap;
+	if (vcap->tiling.enabled)
+	{
+		// Map tile boxes back to the frame and merge them across seams
+		vector<Detection> merged;
+		vcap->tiling.merge(detResult.detections, threshold, &merged);
+		detResult.detections.swap(merged);
+		toSSD(detResult.detections, &detResult.ssd);
+	}
+	if (!options.recordPath.empty())
+	{
+		int64_t nowUs = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+		recorder.write(vcap->streamId, vcap->frameCount, nowUs, detResult);
+	}
+
+	uint64_t counted = 0;
+	for (const Detection &det : detResult.detections)
+	{
+		if (!isCounted(det, usedLabels, threshold))
+			continue;
+		++counted;
+
+		float xmin = det.xmin * vcap->inputWidth;
+		float ymin = det.ymin * vcap->inputHeight;
+		float xmax = det.xmax * vcap->inputWidth;
+		float ymax = det.ymax * vcap->inputHeight;
+
+		rectangle(done_frame, Point((int)xmin, (int)ymin), Point((int)xmax, (int)ymax),
+					Scalar(0, 255, 0), 4, LINE_AA, 0);
+	}
+	++doneDetector->framesInferred;
+	doneDetector->detectionsCounted += counted;
+	metrics().shapeInferred(doneDetector->shapeId, counted);
+
+	countDetections(vcap, detResult.detections, usedLabels, labelPos, threshold, candidateConfidence,
+		[&](int i, int detObj)
+	{
+		int64_t nowUs = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+		time_t t = nowUs / 1000000;
+		tm *currTime = localtime(&t);
+		for (int j = 0; j < detObj; ++j)
+		{
+			string line = recordEvent(vcap, labelNames[i], *currTime);
+			const event &evt = vcap->events.back();
+			archive.append(nowUs, vcap->streamId, vcap->camName, labelNames[i], evt.frame, evt.count);
+			logList.emplace_back(line);
+			cout << line << endl;
+			logFile << line << endl;
+			if (logList.size() > rollingLogSize)
+			{
+				logList.pop_front();
+			}
+
+			if (options.livePort > 0)
+			{
+				std::map<std::string, int> labelTotals;
+				for (int k = 0; k < vcap->noLabels; ++k)
+					labelTotals[labelNames[k]] = vcap->totalCount[k];
+				LiveEvent liveEvt;
+				liveEvt.time = evt.time;
+				liveEvt.content = evt.intruder;
+				liveEvt.videoTime = (float)evt.frame / vcap->fps;
+				liveEvt.count = evt.count;
+				liveFeed.publish("video" + to_string(vcap->streamId + 1), liveEvt, labelTotals);
+			}
+			for (PipelineSink *sink : sinks)
+				sink->onEvent(*vcap, evt, labelNames[i]);
+		}
+
+		// Saving image when detection occurs
+		if (!options.snapshotDir.empty())
+		{
+			char str[64];
+			snprintf(str, sizeof(str), "/%d%d_%s.jpg", currTime->tm_hour, currTime->tm_min, labelNames[i].c_str());
+			MetricTime snapshot_start_time = std::chrono::high_resolution_clock::now();
+			imwrite(options.snapshotDir + str, done_frame);
+			metrics().observeSince(STAGE_SNAPSHOT, snapshot_start_time);
+			tracer().record("snapshot", snapshot_start_time, doneFrameId, vcap->streamId);
+		}
+	});
+	for (PipelineSink *sink : sinks)
+		sink->onFrame(*vcap, done_frame, detResult.detections);
+	metrics().observeSince(STAGE_POSTPROCESS, postprocess_start_time);
+	tracer().record("postprocess", postprocess_start_time, doneFrameId, vcap->streamId);
+
+	display();
+}
+
+
+//----------------------------------------
+// Display the video result and log window
+//----------------------------------------
+void Pipeline::display()
+{
+	VideoCap *vcap = doneVideoCap;
+	if(options.ui  && !(options.loop))
+	{
+		MetricTime write_start_time = std::chrono::high_resolution_clock::now();
+		vcap->vw.write(done_frame);
+		metrics().observeSince(STAGE_WRITE, write_start_time);
+		tracer().record("write", write_start_time, doneFrameId, vcap->streamId);
+	}
+	if (!options.display)
+		return;
+
+	MetricTime display_start_time = std::chrono::high_resolution_clock::now();
+	if (options.mosaicRate <= 0)
+	{
+		int i = 0;
+		logs = Mat(logWinHeight, logWinWidth, CV_8UC1, Scalar(0));
+		for (list<string>::iterator it = logList.begin(); it != logList.end(); ++it)
+		{
+			putText(logs, *it, Point(10, 15 + 20 * i), cv::FONT_HERSHEY_SIMPLEX, 0.5, Scalar(255, 255, 255), 1);
+			++i;
+		}
+	}
+	std::chrono::high_resolution_clock::time_point end_time = std::chrono::high_resolution_clock::now();
+	std::chrono::duration<float> frame_time = std::chrono::duration_cast<std::chrono::duration<float>>(end_time - start_time);
+	char vid_fps[20];
+	sprintf(vid_fps, "FPS: %.2f", 1 / frame_time.count());
+	cv::putText(done_frame, string(vid_fps), cv::Point(10, vcap->inputHeight - 10), cv::FONT_HERSHEY_SIMPLEX,
+				0.5, cv::Scalar(255, 255, 255), 1, 8, false);
+	char infTm[100];
+	if (!options.async)
+	{
+	// In the true async mode, there is no way to measure detection time directly
+	sprintf(infTm, "Infer time: %.3f", inferMs);
+	}
+	else
+	{
+	sprintf(infTm, "Infer time: N/A for Async mode");
+	}
+	cv::putText(done_frame, string(infTm), cv::Point(10, vcap->inputHeight - 30), cv::FONT_HERSHEY_SIMPLEX,
+			0.5, cv::Scalar(255, 255, 255), 1, 8, false);
+	if (options.mosaicRate > 0)
+	{
+		mosaic.submit(vcap->streamId, done_frame, !options.async);
+		mosaic.setLog(logList);
+	}
+	else
+	{
+		cv::imshow(vcap->camName, done_frame);
+		cv::imshow("Intruder Log", logs);
+	}
+	metrics().observeSince(STAGE_DISPLAY, display_start_time);
+	tracer().record("display", display_start_time, doneFrameId, vcap->streamId);
+	start_time = std::chrono::high_resolution_clock::now();
+}
+
+
+bool Pipeline::step()
+{
+	applyConfigChanges();
+
+	std::vector<cv::Mat> images;
+	bool captured = false;
+	for (auto &vidCapObj : vidCaps)
+	{
+		if (vidCapObj.draining || !capture(vidCapObj))
+			continue;
+		captured = true;
+		if (!preprocess(vidCapObj, &images))
+		{
+			failure = 1;
+			return false;
+		}
+		DetectStatus status = infer(vidCapObj, images);
+		postprocess(status);
+		if (status == DETECT_OK && options.loop && !vidCapObj.isCam)
+		{
+			int vfps = (int)round(vidCapObj.vc.get(CAP_PROP_FPS));
+			if (vidCapObj.loopFrames > vidCapObj.vc.get(cv::CAP_PROP_FRAME_COUNT) - round(vfps / minFPS))
+			{
+				vidCapObj.loopFrames = 0;
+				vidCapObj.vc.set(cv::CAP_PROP_POS_FRAMES, 0);
+			}
+		}
+	}
+
+	// Nothing to capture until a stream opening in the background is ready
+	if (!captured && !pendingStreams.empty())
+		pendingStreams.front().result.wait_for(std::chrono::milliseconds(10));
+
+	tracer().poll();
+
+	// Press Esc to exit the application
+	if (options.mosaicRate > 0 ? mosaic.exitRequested() : options.display && waitKey(1) == 27)
+		return false;
+
+	if (stopRequested)
+		return false;
+
+	// Check if all the videos have ended
+	return !(pendingStreams.empty() && std::all_of(vidCaps.begin(), vidCaps.end(),
+		[](const VideoCap &v) { return v.ended; }));
+}
+
+
+int Pipeline::run()
+{
+	while (step())
+		;
+	return failure;
+}
+
+
+void Pipeline::stop()
+{
+	stopRequested = true;
+}
+
+
+void Pipeline::addSink(PipelineSink *sink)
+{
+	sinks.push_back(sink);
+}
+
+
+void Pipeline::close()
+{
+	if (closed)
+		return;
+	closed = true;
+
+	configWatcher.stop();
+	metricsServer.stop();
+	liveFeed.stop();
+	mosaic.stop();
+	recorder.close();
+	archive.close();
+	tracer().dump();
+	if (!started)
+		return;
+
+	// Throughput and detections for each network input shape
+	std::chrono::duration<double> runTime = std::chrono::high_resolution_clock::now() - run_start_time;
+	for (auto &d : detectors)
+	{
+		cout << "Network " << d.second->name << ": " << d.second->framesInferred << " frames ("
+			<< d.second->framesInferred / runTime.count() << " fps), " << d.second->detectionsCounted
+			<< " detections" << endl;
+	}
+
+	// Save the JSON output
+	if (!vidCaps.empty() && !options.uiDataDir.empty())
+		saveJSON(options.uiDataDir, vidCaps.front().events, vidCaps.front());
+	if (options.display)
+		destroyAllWindows();
+}
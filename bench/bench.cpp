@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// Microbenchmarks of the per-frame stages that do not need a model or a
+// video: preprocessing, SSD decoding, counting and the event output, and of
+// queries on the event archive. Inputs are generated from fixed seeds so that
+// runs compare across builds.
+
+#include <cstdlib>
+#include <ctime>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+#include <pipeline.hpp>
+#include <counting.hpp>
+#include <event_archive.hpp>
+#include <preprocess.hpp>
+
+static const unsigned bench_seed = 42;
+static const int bench_frames = 1024; // Frames in a synthetic detection sequence
+static const int bench_labels = 4;
+static const int bench_streams = 8;
+static const int64_t bench_eventUs = 10 * 1000000ll; // One archived event every 10 s
+
+// A noisy BGR frame
+static cv::Mat syntheticFrame(int width, int height)
+{
+	cv::Mat frame(height, width, CV_8UC3);
+	cv::RNG rng(bench_seed);
+	rng.fill(frame, cv::RNG::UNIFORM, 0, 256);
+	return frame;
+}
+
+// SSD rows for one frame: objects boxes of random labels and confidences,
+// ended by a row with image_id -1 as the networks write them
+static std::vector<float> syntheticSSD(std::mt19937 &rng, int objects)
+{
+	std::uniform_int_distribution<int> label(1, bench_labels);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<float> rows;
+	for (int i = 0; i < objects; ++i)
+	{
+		float x = unit(rng) * 0.8f, y = unit(rng) * 0.8f;
+		float row[ssd_objectSize] = {0, (float)label(rng), unit(rng), x, y, x + 0.1f, y + 0.2f};
+		rows.insert(rows.end(), row, row + ssd_objectSize);
+	}
+	float end[ssd_objectSize] = {-1, 0, 0, 0, 0, 0, 0};
+	rows.insert(rows.end(), end, end + ssd_objectSize);
+	return rows;
+}
+
+// Detections of a scene where people come and go: the object count holds
+// for a random number of frames before changing, so the debouncing in
+// countDetections both accepts and rejects counts
+static std::vector<std::vector<Detection>> syntheticSequence()
+{
+	std::mt19937 rng(bench_seed);
+	std::uniform_int_distribution<int> objects(0, 6);
+	std::uniform_int_distribution<int> hold(1, 12);
+	std::vector<std::vector<Detection>> frames;
+	while ((int)frames.size() < bench_frames)
+	{
+		std::vector<float> rows = syntheticSSD(rng, objects(rng));
+		std::vector<Detection> detections;
+		parseSSD(rows.data(), rows.size() / ssd_objectSize, &detections);
+		for (int i = hold(rng); i > 0 && (int)frames.size() < bench_frames; --i)
+			frames.push_back(detections);
+	}
+	return frames;
+}
+
+static VideoCap syntheticStream()
+{
+	VideoCap vcap(1920, 1080, 30.0, "Cam 1");
+	vcap.init(bench_labels);
+	return vcap;
+}
+
+
+// Resize a 1080p frame to the network input and write it planar, as
+// OpenVinoDetector does for every frame
+template <typename T>
+static void BM_FillPlanar(benchmark::State &state)
+{
+	const size_t width = state.range(0), height = state.range(1), channels = 3;
+	cv::Mat frame = syntheticFrame(1920, 1080);
+	std::vector<T> input(width * height * channels);
+	for (auto _ : state)
+	{
+		fillPlanar(frame, input.data(), width, height, channels);
+		benchmark::DoNotOptimize(input.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_FillPlanar, uint8_t)->Args({300, 300})->Args({544, 320})->Args({1920, 1080});
+BENCHMARK_TEMPLATE(BM_FillPlanar, float)->Args({300, 300})->Args({544, 320})->Args({1920, 1080});
+
+
+// Decode one frame's worth of SSD rows
+static void BM_ParseSSD(benchmark::State &state)
+{
+	std::mt19937 rng(bench_seed);
+	std::vector<float> rows = syntheticSSD(rng, state.range(0));
+	std::vector<Detection> detections;
+	for (auto _ : state)
+	{
+		parseSSD(rows.data(), rows.size() / ssd_objectSize, &detections);
+		benchmark::DoNotOptimize(detections.data());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ParseSSD)->Arg(10)->Arg(100)->Arg(200);
+
+
+// Count and debounce the detections of one frame, frames taken in turn from
+// the synthetic sequence
+static void BM_CountDetections(benchmark::State &state)
+{
+	std::vector<std::vector<Detection>> frames = syntheticSequence();
+	std::vector<bool> usedLabels(bench_labels, true);
+	std::vector<int> labelPos;
+	for (int i = 0; i < bench_labels; ++i)
+		labelPos.push_back(i);
+	VideoCap vcap = syntheticStream();
+	int64_t events = 0;
+	size_t f = 0;
+	for (auto _ : state)
+	{
+		countDetections(&vcap, frames[f], usedLabels, labelPos, conf_thresholdValue, conf_candidateConfidence,
+			[&](int i, int detObj) { events += detObj; });
+		f = (f + 1) % frames.size();
+	}
+	state.SetItemsProcessed(state.iterations());
+	state.counters["events"] = benchmark::Counter(events, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_CountDetections);
+
+
+// Add an event to a stream whose recent event window is full
+static void BM_RecordEvent(benchmark::State &state)
+{
+	VideoCap vcap = syntheticStream();
+	tm when = {};
+	when.tm_hour = 12;
+	for (size_t i = 0; i < conf_recentEvents; ++i)
+		recordEvent(&vcap, "person", when);
+	for (auto _ : state)
+	{
+		std::string line = recordEvent(&vcap, "person", when);
+		benchmark::DoNotOptimize(line.data());
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RecordEvent);
+
+
+// Write the UI's events.json and data.json for a stream's recent events
+static void BM_WriteEventJSON(benchmark::State &state)
+{
+	VideoCap vcap = syntheticStream();
+	tm when = {};
+	for (int i = 0; i < state.range(0); ++i)
+	{
+		vcap.frameCount = i * 5;
+		recordEvent(&vcap, "person", when);
+	}
+	for (auto _ : state)
+	{
+		std::ostringstream evtJson, dataJson;
+		writeEventJSON(vcap.events, vcap.fps, evtJson, dataJson);
+		benchmark::DoNotOptimize(evtJson.tellp());
+		benchmark::DoNotOptimize(dataJson.tellp());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_WriteEventJSON)->Arg(10)->Arg(conf_recentEvents);
+
+
+// Archives of a given number of events, written once per run into temporary
+// directories that are removed at exit
+class BenchArchives {
+public:
+	~BenchArchives()
+	{
+		for (auto &a : dirs)
+		{
+			for (const std::string &name : archiveSegments(a.second))
+				unlink((a.second + "/" + name).c_str());
+			rmdir(a.second.c_str());
+		}
+	}
+
+	const std::string &get(int records)
+	{
+		std::string &dir = dirs[records];
+		if (!dir.empty())
+			return dir;
+		char path[] = "/tmp/intruder-bench-XXXXXX";
+		dir = mkdtemp(path);
+
+		static const char *labels[bench_labels] = {"person", "car", "bike", "dog"};
+		std::mt19937 rng(bench_seed);
+		std::uniform_int_distribution<int> stream(0, bench_streams - 1);
+		std::uniform_int_distribution<int> label(0, bench_labels - 1);
+		EventArchive archive;
+		archive.open(dir);
+		for (int i = 0; i < records; ++i)
+		{
+			int s = stream(rng);
+			archive.append(i * bench_eventUs, s, "Cam " + std::to_string(s + 1), labels[label(rng)], i, i);
+		}
+		archive.close();
+		return dir;
+	}
+
+private:
+	std::map<int, std::string> dirs;
+};
+
+// Count the events of one stream and label in a two hour window, as
+// intruder-archive does, in archives of growing length. Records read per
+// query stay flat as the archive grows; only the segment headers are added.
+static void BM_ArchiveQuery(benchmark::State &state)
+{
+	static BenchArchives archives;
+	ArchiveReader reader;
+	reader.open(archives.get(state.range(0)));
+	int64_t fromUs = state.range(0) / 2 * bench_eventUs;
+	int64_t toUs = fromUs + 2 * 3600 * 1000000ll;
+	uint64_t matched = 0, visited = 0;
+	for (auto _ : state)
+		visited += reader.query(fromUs, toUs, "Cam 3", "person", [&](const ArchiveRecord &r) { ++matched; });
+	state.SetItemsProcessed(state.iterations());
+	state.counters["records_read"] = benchmark::Counter(visited, benchmark::Counter::kAvgIterations);
+	state.counters["events"] = benchmark::Counter(matched, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_ArchiveQuery)->Arg(1 << 16)->Arg(1 << 18)->Arg(1 << 20);
+
+
+BENCHMARK_MAIN();
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// Counting and debouncing of the detections scripted in
+// resources/synthetic.json, fed through SyntheticDetector as in the pipeline.
+// Usage: intruder-test-counting SYNTHETIC_JSON
+
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include <counting.hpp>
+#include <recording.hpp>
+#include <synthetic_detector.hpp>
+
+#include "check.hpp"
+
+// Run frames frames of the script through detection and counting. Labels 1
+// and 3 of the model are counted, as "person" and "car".
+static void runScript(const std::string &script, int frames, VideoCap *vcap)
+{
+	SyntheticDetector detector(script);
+	std::vector<bool> usedLabels = {true, false, true};
+	std::vector<int> labelPos = {0, 0, 1};
+	std::vector<std::string> labelNames = {"person", "car"};
+	tm when = {};
+
+	DetectorResult result;
+	CHECK_EQ(detector.wait(&result), DETECT_NOT_STARTED);
+	for (int f = 0; f < frames; ++f)
+	{
+		detector.submit(cv::Mat());
+		CHECK_EQ(detector.wait(&result), DETECT_OK);
+		countDetections(vcap, result.detections, usedLabels, labelPos, conf_thresholdValue,
+			conf_candidateConfidence, [&](int i, int detObj)
+		{
+			for (int j = 0; j < detObj; ++j)
+				recordEvent(vcap, labelNames[i], when);
+		});
+	}
+}
+
+// The script decodes to SSD rows with the model's label numbering
+static void testScriptDecoding(const std::string &script)
+{
+	SyntheticDetector detector(script);
+	CHECK_EQ(detector.inputWidth(), 1024u);
+	CHECK_EQ(detector.inputHeight(), 1024u);
+
+	DetectorResult result;
+	for (int f = 0; f < 4; ++f)
+	{
+		detector.submit(cv::Mat());
+		CHECK_EQ(detector.wait(&result), DETECT_OK);
+	}
+	// Frame 3 has a person and a car
+	CHECK_EQ(result.detections.size(), 2u);
+	CHECK_EQ(result.detections[0].label, 0);
+	CHECK_EQ(result.detections[1].label, 2);
+	CHECK(result.detections[1].confidence > 0.8f);
+	CHECK_EQ(result.ssd.size(), 3u * ssd_objectSize);
+}
+
+// Each object is counted once, after it has been seen for
+// conf_candidateConfidence frames in a row, and never again while it stays
+static void testEvents(const std::string &script)
+{
+	VideoCap vcap(1920, 1080, 30.0, "Cam 1");
+	vcap.init(2);
+	runScript(script, 30, &vcap);
+
+	CHECK_EQ(vcap.frameCount, 30);
+	CHECK_EQ(vcap.totalCount[0], 1);
+	CHECK_EQ(vcap.totalCount[1], 1);
+	CHECK_EQ(vcap.events.size(), 2u);
+	if (vcap.events.size() == 2)
+	{
+		CHECK_EQ(vcap.events[0].intruder, "person");
+		CHECK_EQ(vcap.events[0].frame, 5);
+		CHECK_EQ(vcap.events[0].count, 1);
+		CHECK_EQ(vcap.events[1].intruder, "car");
+		CHECK_EQ(vcap.events[1].frame, 7);
+		CHECK_EQ(vcap.events[1].count, 2);
+	}
+}
+
+// A reload lowering candidate_confidence below a running streak still counts
+// the object, on the next frame
+static void testLoweredConfidence()
+{
+	VideoCap vcap(1920, 1080, 30.0, "Cam 1");
+	vcap.init(1);
+	std::vector<bool> usedLabels = {true};
+	std::vector<int> labelPos = {0};
+	Detection person = {0, 0, 0.9f, 0.1f, 0.1f, 0.2f, 0.4f};
+	std::vector<Detection> detections = {person};
+	int counted = 0;
+	auto onIncrease = [&](int i, int detObj) { counted += detObj; };
+
+	for (int f = 0; f < 4; ++f)
+		countDetections(&vcap, detections, usedLabels, labelPos, conf_thresholdValue, 10, onIncrease);
+	CHECK_EQ(counted, 0);
+	countDetections(&vcap, detections, usedLabels, labelPos, conf_thresholdValue, 2, onIncrease);
+	CHECK_EQ(counted, 1);
+	CHECK_EQ(vcap.totalCount[0], 1);
+
+	// And only once while the object stays
+	for (int f = 0; f < 10; ++f)
+		countDetections(&vcap, detections, usedLabels, labelPos, conf_thresholdValue, 2, onIncrease);
+	CHECK_EQ(counted, 1);
+}
+
+// A recording keeps the thresholds it was counted with, for replay
+static void testRecordedSettings()
+{
+	const char *path = "test_counting.rec";
+	RecordingStream rs;
+	memset(&rs, 0, sizeof(rs));
+	strncpy(rs.name, "Cam 1", recording_nameSize - 1);
+	{
+		Recorder recorder;
+		CHECK(recorder.open(path, {rs}, {0, -1, 1}, {"person", "car"}, 0.7, 3));
+	}
+
+	RecordingReader reader;
+	CHECK(reader.open(path));
+	CHECK_EQ(reader.header.version, recording_version);
+	CHECK(reader.header.threshold > 0.699f && reader.header.threshold < 0.701f);
+	CHECK_EQ(reader.header.candidateConfidence, 3u);
+	CHECK_EQ(reader.streams.size(), 1u);
+	CHECK_EQ(reader.usedLabels.size(), 2u);
+	std::remove(path);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		std::cout << argv[0] << " SYNTHETIC_JSON" << std::endl;
+		return 2;
+	}
+	testScriptDecoding(argv[1]);
+	testEvents(argv[1]);
+	testLoweredConfidence();
+	testRecordedSettings();
+	return checkFailures();
+}
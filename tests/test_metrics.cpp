@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+// Metric slots of labels and streams across config reloads
+
+#include <string>
+#include <vector>
+
+#include <metrics.hpp>
+
+#include "check.hpp"
+
+static bool scraped(const std::string &line)
+{
+	return metrics().scrape().find(line + "\n") != std::string::npos;
+}
+
+// Removing a label keeps the counts of the others under their own names
+static void testLabelSlots()
+{
+	metrics().setLabelNames({"person", "bicycle", "car"});
+	metrics().eventDetected("person");
+	metrics().eventDetected("bicycle");
+	metrics().eventDetected("bicycle");
+
+	metrics().setLabelNames({"person", "car"});
+	metrics().eventDetected("car");
+	CHECK(scraped("intruder_events_total{label=\"person\"} 1"));
+	CHECK(scraped("intruder_events_total{label=\"bicycle\"} 2"));
+	CHECK(scraped("intruder_events_total{label=\"car\"} 1"));
+}
+
+// Slots of removed streams are reused, starting from zero, and removed
+// streams leave the scrape
+static void testStreamSlots()
+{
+	int first = metrics().addStream("Cam 1");
+	CHECK_EQ(first, 0);
+	metrics().frameDecoded(first, 5);
+	CHECK(scraped("intruder_frames_decoded_total{stream=\"Cam 1\"} 5"));
+
+	for (int i = 0; i < 3 * metrics_maxStreams; ++i)
+	{
+		metrics().removeStream(first);
+		first = metrics().addStream("Cam " + std::to_string(i + 2));
+		CHECK_EQ(first, 0);
+	}
+	CHECK(!scraped("intruder_frames_decoded_total{stream=\"Cam 1\"} 5"));
+	metrics().frameDecoded(first, 2);
+	CHECK(scraped("intruder_frames_decoded_total{stream=\"Cam " + std::to_string(3 * metrics_maxStreams + 1) + "\"} 2"));
+
+	std::vector<int> slots;
+	for (int i = 1; i < metrics_maxStreams; ++i)
+		slots.push_back(metrics().addStream("extra"));
+	CHECK_EQ(slots.back(), metrics_maxStreams - 1);
+	CHECK_EQ(metrics().addStream("one too many"), -1);
+	metrics().frameDecoded(-1);
+}
+
+int main()
+{
+	metrics().enabled = true;
+	testLabelSlots();
+	testStreamSlots();
+	return checkFailures();
+}
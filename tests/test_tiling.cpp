@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2018 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// Tile layout, seam merging and batched inference of tiled streams
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <synthetic_detector.hpp>
+#include <tiling.hpp>
+
+#include "check.hpp"
+
+static bool near(float a, float b)
+{
+	return std::fabs(a - b) < 1e-3f;
+}
+
+static Detection box(int label, float confidence, float xmin, float ymin, float xmax, float ymax)
+{
+	Detection d;
+	d.imageId = 0;
+	d.label = label;
+	d.confidence = confidence;
+	d.xmin = xmin;
+	d.ymin = ymin;
+	d.xmax = xmax;
+	d.ymax = ymax;
+	return d;
+}
+
+// Every tile lies inside the frame, the tiles reach all four borders, and
+// neighbours overlap by at least overlap of the tile size
+static void checkLayout(cv::Size frame, cv::Size tile, float overlap, size_t expected)
+{
+	std::vector<cv::Rect> tiles = makeTiles(frame, tile, overlap);
+	CHECK_EQ(tiles.size(), expected);
+
+	int right = 0, bottom = 0;
+	for (size_t i = 0; i < tiles.size(); ++i)
+	{
+		const cv::Rect &t = tiles[i];
+		CHECK(t.x >= 0 && t.y >= 0);
+		CHECK(t.x + t.width <= frame.width && t.y + t.height <= frame.height);
+		CHECK_EQ(t.width, std::min(tile.width, frame.width));
+		CHECK_EQ(t.height, std::min(tile.height, frame.height));
+		right = std::max(right, t.x + t.width);
+		bottom = std::max(bottom, t.y + t.height);
+
+		// Tiles are laid out row by row
+		if (i > 0 && tiles[i - 1].y == t.y)
+			CHECK(tiles[i - 1].x + tiles[i - 1].width - t.x >= (int)std::floor(overlap * tile.width));
+	}
+	CHECK_EQ(tiles.front().x, 0);
+	CHECK_EQ(tiles.front().y, 0);
+	CHECK_EQ(right, frame.width);
+	CHECK_EQ(bottom, frame.height);
+}
+
+static void testMakeTiles()
+{
+	// 1080p in 300x300 tiles: 8 columns, 5 rows, the last ones flush with the border
+	checkLayout(cv::Size(1920, 1080), cv::Size(300, 300), 0.2f, 40);
+	std::vector<cv::Rect> tiles = makeTiles(cv::Size(1920, 1080), cv::Size(300, 300), 0.2f);
+	CHECK_EQ(tiles.back().x, 1620);
+	CHECK_EQ(tiles.back().y, 780);
+
+	// A frame exactly one tile large, and one smaller than a tile
+	checkLayout(cv::Size(300, 300), cv::Size(300, 300), 0.2f, 1);
+	checkLayout(cv::Size(200, 100), cv::Size(300, 300), 0.2f, 1);
+
+	// Smaller than a tile in one direction only: one row cut to the frame height
+	checkLayout(cv::Size(1000, 200), cv::Size(300, 300), 0.2f, 4);
+
+	// One pixel wider than a tile still needs a second, almost fully overlapping tile
+	checkLayout(cv::Size(301, 300), cv::Size(300, 300), 0.2f, 2);
+
+	// No overlap requested: tiles only touch
+	checkLayout(cv::Size(600, 300), cv::Size(300, 300), 0.0f, 2);
+}
+
+static void testSuppressOverlaps()
+{
+	// The part of an object cut by a seam is merged into the whole object
+	std::vector<Detection> dets = {
+		box(0, 0.6f, 0.50f, 0.2f, 0.60f, 0.4f),
+		box(0, 0.9f, 0.45f, 0.2f, 0.60f, 0.4f)};
+	suppressOverlaps(&dets, tiling_nmsThreshold);
+	CHECK_EQ(dets.size(), 1u);
+	if (dets.size() == 1)
+		CHECK(near(dets[0].confidence, 0.9f));
+
+	// Other labels, separate boxes and boxes only touching are all kept,
+	// most confident first
+	dets = {
+		box(0, 0.7f, 0.1f, 0.1f, 0.3f, 0.3f),
+		box(1, 0.8f, 0.1f, 0.1f, 0.3f, 0.3f),
+		box(0, 0.9f, 0.6f, 0.6f, 0.8f, 0.8f),
+		box(0, 0.6f, 0.3f, 0.1f, 0.5f, 0.3f)};
+	suppressOverlaps(&dets, tiling_nmsThreshold);
+	CHECK_EQ(dets.size(), 4u);
+	for (size_t i = 1; i < dets.size(); ++i)
+		CHECK(dets[i - 1].confidence >= dets[i].confidence);
+
+	// Overlap below the threshold keeps both
+	dets = {
+		box(0, 0.9f, 0.0f, 0.0f, 0.4f, 0.4f),
+		box(0, 0.8f, 0.3f, 0.0f, 0.7f, 0.4f)};
+	suppressOverlaps(&dets, tiling_nmsThreshold);
+	CHECK_EQ(dets.size(), 2u);
+
+	std::vector<Detection> none;
+	suppressOverlaps(&none, tiling_nmsThreshold);
+	CHECK(none.empty());
+}
+
+// A person at 200-350 px of a 600 px frame, seen by three 300 px tiles
+// overlapping by half: cut at the right edge of tile 0, whole in tile 1 and
+// cut at the left edge of tile 2. The batched result merges into one box.
+static void testBatchedMerge()
+{
+	const char *scriptPath = "test_tiling_script.json";
+	{
+		std::ofstream script(scriptPath);
+		script << "{\"input\": [300, 300], \"frames\": ["
+			"{\"boxes\": [[1, 0.7, 0.6667, 0.2, 1.0, 0.8]]},"
+			"{\"boxes\": [[1, 0.9, 0.1667, 0.2, 0.6667, 0.8], [3, 0.3, 0.1, 0.1, 0.2, 0.2]]},"
+			"{\"boxes\": [[1, 0.6, 0.0, 0.2, 0.1667, 0.8]]}]}";
+	}
+	SyntheticDetector detector(scriptPath);
+
+	TileState tiling;
+	tiling.enabled = true;
+	tiling.overlap = 0.5f;
+	tiling.init(cv::Size(600, 300), cv::Size(300, 300));
+	CHECK_EQ(tiling.tiles.size(), 3u);
+	CHECK(detector.batchSize() >= tiling.tiles.size());
+
+	std::vector<cv::Mat> images(tiling.select(cv::Mat()).size());
+	CHECK_EQ(images.size(), 3u);
+	detector.submitBatch(images);
+
+	DetectorResult result;
+	CHECK_EQ(detector.wait(&result), DETECT_OK);
+	CHECK_EQ(result.detections.size(), 4u);
+	for (size_t i = 0; i < result.detections.size(); ++i)
+		CHECK_EQ(result.detections[i].imageId, i < 1 ? 0 : i < 3 ? 1 : 2);
+
+	std::vector<Detection> merged;
+	tiling.merge(result.detections, 0.5f, &merged);
+	CHECK_EQ(merged.size(), 1u);
+	if (merged.size() == 1)
+	{
+		CHECK_EQ(merged[0].label, 0);
+		CHECK(near(merged[0].confidence, 0.9f));
+		CHECK(near(merged[0].xmin, 200.0f / 600));
+		CHECK(near(merged[0].xmax, 350.0f / 600));
+		CHECK(near(merged[0].ymin, 0.2f));
+		CHECK(near(merged[0].ymax, 0.8f));
+	}
+
+	// The next batch continues in the script, wrapping around
+	std::vector<cv::Mat> one(1);
+	detector.submitBatch(one);
+	CHECK_EQ(detector.wait(&result), DETECT_OK);
+	CHECK_EQ(result.detections.size(), 1u);
+	CHECK_EQ(result.detections[0].imageId, 0);
+	CHECK(near(result.detections[0].confidence, 0.7f));
+
+	std::remove(scriptPath);
+}
+
+int main()
+{
+	testMakeTiles();
+	testSuppressOverlaps();
+	testBatchedMerge();
+	return checkFailures();
+}